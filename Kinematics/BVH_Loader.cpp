@@ -218,7 +218,9 @@ void frame(long fr)
 
 void render() {
 	body.render();
-	
+}
+
+void renderGround() {
 	JR::drawQuad(jm::vec3(0), jm::vec3(0, 1, 0), jm::vec2(1000), jm::vec4(0, 0, .4, 1));
 }
 
@@ -239,6 +241,7 @@ int main() {
 	view->drag3DCB(drag3D);
 	view->frameCB(frame);
 	view->renderFunc(render);
+	view->staticFunc(renderGround);
 	view->dndCallback(load);
 	win->show();
 	_JGL::run();
@@ -150,12 +150,7 @@ inline void Aligner::rearrangeChildren(NVGcontext* vg, const rct_t& r, autoscale
 
 
 inline void Aligner::rearrange(NVGcontext* vg,autoscale_t scaling) {
-	{
-		std::unique_lock<std::mutex> lock(_childMutex);
-		for( auto c: _children ) if( c ) {
-			if( c->changed() ) c->reform(vg,autoscale_t::ALL);
-		}
-	}
+	reformChangedChildren(vg);
 	autoscale_t sc = autoscale()&scaling;
 
 	if( changed() ) {
@@ -179,6 +174,7 @@ inline void Aligner::spacing( float s ) {
 }
 
 inline sz2_t Aligner::minSize() const {
+	if( _minSizeValid ) return _minSizeCache;
 	float ww = 0, hh = 0;
 	if( _type == direction_t::VERTICAL ) hh = spacing();
 	else					ww = spacing();
@@ -193,7 +189,9 @@ inline sz2_t Aligner::minSize() const {
 			hh = std::max( hh, sz.h );
 		}
 	};
-	return sz2_t(ww,hh);
+	_minSizeCache = sz2_t(ww,hh);
+	_minSizeValid = true;
+	return _minSizeCache;
 }
 
 } // namespace JGL2
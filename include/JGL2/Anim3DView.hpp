@@ -30,6 +30,11 @@ struct Anim3DView : public Render3DView<T>, public _Timeline {
 	virtual void drawContents(NVGcontext* vg, const rct_t&r, align_t a ) override {
 		drawTimeline(vg,r,a);
 	}
+protected:
+	virtual void frameChanged() override {
+		Render3DView<T>::renderer().sceneChanged();
+		_Timeline::frameChanged();
+	}
 };
 
 }
@@ -14,12 +14,17 @@
 #endif
 
 #include <mutex>
+#include <memory>
+#include <vector>
+#include <cmath>
 #include <functional>
 #include <JGL2/Widget.hpp>
 #include <JGL2/_Scrollable.hpp>
 
 namespace JGL2 {
 
+struct _DrawCache;
+
 struct Group: public Widget, public _Scrollable {
 	
 	Group(float x, float y, float w, float h, const str_t& label="");
@@ -36,11 +41,20 @@ struct Group: public Widget, public _Scrollable {
 	virtual Widget*			underMouse();
 	virtual Widget*			underWidget(const pos_t& pt);
 	
-	virtual	bool			changed() const override;
+	virtual	bool			changed() const override { return _changed || _childChanged; }
+	virtual void			change() override;
+	virtual void			childChanged() override;
+	virtual void			reform(NVGcontext* vg, autoscale_t scaling) override;
 	
 	virtual	bool			containing(const Widget* w) const override;
 	virtual	void			forAllChild( std::function<void(Widget*)> func ) { for( auto c: _children) func(c); }
 
+// Keeps the drawing of this subtree in an offscreen image, re-rendered only when
+// something in the subtree is damaged or animated
+	virtual void			cacheDrawing(bool b) { _cacheDrawing = b; _cacheDirty = true; damage(); }
+	virtual bool			cacheDrawing() const { return _cacheDrawing; }
+	virtual void			invalidate(const rct_t& r, bool animating) override;
+
 
 protected:
 	
@@ -58,23 +72,71 @@ protected:
 	virtual bool			propagateEvent( event_t event );
 	virtual void			recursiveDrawGL();
 	virtual void			rearrangeChildren(NVGcontext* vg, const rct_t& r, autoscale_t scaling);
+	// Reforms only the children with a pending change
+	virtual void			reformChangedChildren(NVGcontext* vg);
+	inline void				updateChildChanged();
+	inline void				buildHitGrid();
+	inline const std::vector<uint32_t>* hitCell(const pos_t& p) const;
+	// Defined in _DrawCache.hpp
+	virtual void			updateDrawCaches(NVGcontext* vg, float scale);
+	virtual bool			drawCached(NVGcontext* vg);
+	inline bool				isCached(Widget* c) const;
 
 	widget_list_t			_children;
 	mutable std::mutex		_childMutex;
+
+	// Set when a descendant changed, so unchanged subtrees are skipped without a walk
+	bool					_childChanged		= false;
+	// For subclasses computing minSize() from their children; cleared by any change below
+	mutable bool			_minSizeValid		= false;
+	mutable sz2_t			_minSizeCache;
+
+	// Uniform grid over the children's rects, so underWidget() in large groups (thumbnail
+	// matrices, long tables) tests only the children near the point. Rebuilt lazily after
+	// any change or reform of the group.
+	static constexpr size_t	HIT_GRID_MIN_CHILDREN = 64;
+	struct HitGrid {
+		rct_t				bound;
+		int					nx = 0, ny = 0;
+		std::vector<std::vector<uint32_t>> cells;
+	};
+	HitGrid					_hitGrid;
+	bool					_hitGridValid		= false;
+
+	bool					_cacheDrawing		= false;
+	bool					_cacheDirty			= true;
+	bool					_cacheReady			= false;
+	float					_cacheScale			= 1;
+	std::shared_ptr<_DrawCache> _drawCache;
 	
 	friend _JGL;
 };
 
 inline Group::Group(float x, float y, float w, float h, const str_t& label )
 : Widget( x, y, w, h, label ) {
+	_groupPtr = this;
+	_scrollablePtr = this;
 	_JGL::pushAddingGroup( this );
 }
 
 inline Group::Group(const pos_t& pos, const sz2_t& sz, const str_t& label )
 : Widget( pos,sz, label ) {
+	_groupPtr = this;
+	_scrollablePtr = this;
 	_JGL::pushAddingGroup( this );
 }
 
+inline bool Group::isCached(Widget* c) const {
+	Group* g = c->groupPtr();
+	return g && g->_cacheDrawing && g->_cacheReady;
+}
+
+inline void Group::invalidate(const rct_t& r, bool animating) {
+	_cacheDirty = true;
+	// Children are drawn clipped to this group
+	Widget::invalidate( intersection( r, rct_t(0,0,w(),h()) ), animating );
+}
+
 inline idx_t Group::searchChild( Widget* w ) const {
 	std::unique_lock<std::mutex> lock(_childMutex);
 	for( size_t i=0; i<children(); i++ )
@@ -116,12 +178,78 @@ inline void Group::end() {
 	_JGL::popAddingGroupUntil( this );
 }
 
-inline bool Group::changed() const {
-	if( _changed ) return true;
+inline void Group::change() {
+	_minSizeValid = false;
+	_hitGridValid = false;
+	Widget::change();
+}
+
+inline void Group::childChanged() {
+	_childChanged = true;
+	_minSizeValid = false;
+	if( parent() )
+		parent()->childChanged();
+}
+
+inline void Group::updateChildChanged() {
+	_childChanged = false;
+	for( auto c: _children ) if( c && c->changed() ) {
+		_childChanged = true;
+		break;
+	}
+}
+
+inline void Group::reformChangedChildren(NVGcontext* vg) {
+	std::unique_lock<std::mutex> lock(_childMutex);
 	for( auto c: _children ) if( c ) {
-		if( c->changed() ) return true;
+		if( c->changed() ) c->reform(vg,autoscale_t::ALL);
 	}
-	return false;
+	updateChildChanged();
+}
+
+inline void Group::reform(NVGcontext* vg, autoscale_t scaling) {
+	Widget::reform(vg,scaling);
+	updateChildChanged();
+	_hitGridValid = false;
+}
+
+inline void Group::buildHitGrid() {
+	_hitGridValid = true;
+	_hitGrid.cells.clear();
+	_hitGrid.nx = _hitGrid.ny = 0;
+	rct_t b(0,0,-1,-1);
+	for( auto c: _children ) if( c ) {
+		if( b.w<0 ) b = c->bound();
+		else b.increase( c->bound() );
+	}
+	if( b.w<0 ) return;
+	// Margin so that a point on an edge is never binned away from a child that contains it
+	const float eps = .5f;
+	b = rct_t( b.x-eps, b.y-eps, b.w+eps*2, b.h+eps*2 );
+	float n = float(_children.size());
+	int nx = std::max( 1, std::min( int(n), int(roundf( sqrtf( n*b.w/b.h ) )) ) );
+	int ny = std::max( 1, int(ceilf( n/nx )) );
+	_hitGrid.bound = b;
+	_hitGrid.nx = nx;
+	_hitGrid.ny = ny;
+	_hitGrid.cells.resize( size_t(nx*ny) );
+	auto cx = [&](float x) { return std::max( 0, std::min( nx-1, int( (x-b.x)*nx/b.w ) ) ); };
+	auto cy = [&](float y) { return std::max( 0, std::min( ny-1, int( (y-b.y)*ny/b.h ) ) ); };
+	for( size_t i=0; i<_children.size(); i++ ) if( _children[i] ) {
+		rct_t r = _children[i]->bound();
+		int x0 = cx(r.x-eps), x1 = cx(r.x+r.w+eps);
+		int y0 = cy(r.y-eps), y1 = cy(r.y+r.h+eps);
+		for( int y=y0; y<=y1; y++ ) for( int x=x0; x<=x1; x++ )
+			_hitGrid.cells[size_t(y*nx+x)].push_back( uint32_t(i) );
+	}
+}
+
+inline const std::vector<uint32_t>* Group::hitCell(const pos_t& p) const {
+	const HitGrid& g = _hitGrid;
+	if( g.nx<1 || !g.bound.in(p) ) return nullptr;
+	int x = std::min( g.nx-1, int( (p.x-g.bound.x)*g.nx/g.bound.w ) );
+	int y = std::min( g.ny-1, int( (p.y-g.bound.y)*g.ny/g.bound.h ) );
+	return &g.cells[size_t(y*g.nx+x)];
 }
 
 inline bool Group::containing(const Widget* w) const {
@@ -139,9 +267,8 @@ inline Widget* Group::underMouse() {
 
 inline Widget* Group::underWidget(const pos_t& pt) {
 	if( under(pt) ) {
-		std::unique_lock<std::mutex> lock(_childMutex);
-		for( auto& c: _children ) if( c ) {
-			Group* g = dynamic_cast<Group*>(c);
+		auto test = [&](Widget* c) -> Widget* {
+			Group* g = c->groupPtr();
 			if( g ) {
 				Widget* ret = g->underWidget(pt);
 				if( ret )
@@ -149,6 +276,22 @@ inline Widget* Group::underWidget(const pos_t& pt) {
 			}
 			if( c->under(pt) )
 				return c;
+			return nullptr;
+		};
+		std::unique_lock<std::mutex> lock(_childMutex);
+		if( _children.size()>=HIT_GRID_MIN_CHILDREN ) {
+			if( !_hitGridValid ) buildHitGrid();
+			// Candidates in child order, so the result matches the linear search
+			const std::vector<uint32_t>* cell = hitCell( pt-abs_pos()+scrollOffset() );
+			if( cell ) for( auto i: *cell ) if( _children[i] ) {
+				Widget* ret = test( _children[i] );
+				if( ret ) return ret;
+			}
+			return this;
+		}
+		for( auto& c: _children ) if( c ) {
+			Widget* ret = test( c );
+			if( ret ) return ret;
 		}
 		return this;
 	}
@@ -157,15 +300,16 @@ inline Widget* Group::underWidget(const pos_t& pt) {
 
 inline void Group::drawBox(NVGcontext* vg, const rct_t& r) {
 	nvgSave( vg );
-	_Scrollable* sc = dynamic_cast<_Scrollable*>(this);
+	_Scrollable* sc = scrollablePtr();
 	if( sc )
 		nvgTranslate(vg, -sc->scrollOffset().x, -sc->scrollOffset().y );
 	std::unique_lock<std::mutex> lock(_childMutex);
-	for( auto c : _children ) if( c && !c->hidden() ) {
+	for( auto c : _children ) if( c && !c->hidden() && c->inRedrawRect() ) {
 		nvgSave( vg );
 		nvgTranslate( vg, c->x(), c->y() );
 		nvgIntersectScissor( vg, 0, 0, c->w(), c->h() );
-		c->drawBox(vg,rct_t(0,0,c->w(), c->h()));
+		if( !isCached(c) || !static_cast<Group*>(c)->drawCached(vg) )
+			c->drawBox(vg,rct_t(0,0,c->w(), c->h()));
 		nvgRestore(vg);
 	}
 	nvgRestore(vg);
@@ -173,18 +317,18 @@ inline void Group::drawBox(NVGcontext* vg, const rct_t& r) {
 
 inline void Group::drawBoxOver(NVGcontext* vg, const rct_t& r) {
 	nvgSave( vg );
-	_Scrollable* sc = dynamic_cast<_Scrollable*>(this);
+	_Scrollable* sc = scrollablePtr();
 	if( sc )
 		nvgTranslate(vg, -sc->scrollOffset().x, -sc->scrollOffset().y );
 	std::unique_lock<std::mutex> lock(_childMutex);
-	for( auto c : _children ) if( c && !c->hidden() ) {
+	for( auto c : _children ) if( c && !c->hidden() && !isCached(c) && c->inRedrawRect() ) {
 		nvgSave( vg );
 		nvgTranslate( vg, c->x(), c->y() );
 		nvgIntersectScissor( vg, 0, 0, c->w(), c->h() );
 		nvgSave( vg );
 		c->drawBoxOver(vg,rct_t(0,0,c->w(), c->h()));
 		nvgRestore(vg);
-		_Scrollable* sc = dynamic_cast<_Scrollable*>(c);
+		_Scrollable* sc = c->scrollablePtr();
 		if( sc && sc->scrollDrawIndicators(vg) )
 			animate();
 		nvgRestore(vg);
@@ -195,11 +339,11 @@ inline void Group::drawBoxOver(NVGcontext* vg, const rct_t& r) {
 
 inline void Group::drawContents(NVGcontext* vg, const rct_t& r, align_t align ) {
 	std::unique_lock<std::mutex> lock(_childMutex);
-	for( auto c : _children ) if( c && !c->hidden() ) {
+	for( auto c : _children ) if( c && !c->hidden() && !isCached(c) && c->inRedrawRect() ) {
 		nvgSave( vg );
 		nvgTranslate( vg, c->x(), c->y() );
 		nvgIntersectScissor( vg, 0, 0, c->w(), c->h() );
-		_Scrollable* sc = dynamic_cast<_Scrollable*>(c);
+		_Scrollable* sc = c->scrollablePtr();
 		if( sc )
 			nvgTranslate(vg, -sc->scrollOffset().x, -sc->scrollOffset().y );
 		if( c->quickUIDraw(vg) ) c->animate();
@@ -210,13 +354,14 @@ inline void Group::drawContents(NVGcontext* vg, const rct_t& r, align_t align )
 }
 
 inline void Group::recursiveDrawGL() {
+	JGL2_PROFILE_ZONE("Group::recursiveDrawGL");
 	preDrawGL();
 	drawGL();
 	postDrawGL();
 
 	std::unique_lock<std::mutex> lock(_childMutex);
-	for( auto c : _children ) if( c ){
-		Group* g = dynamic_cast<Group*>(c);
+	for( auto c : _children ) if( c && c->inRedrawRect() ){
+		Group* g = c->groupPtr();
 		if( g ) {
 			g->recursiveDrawGL();
 		}
@@ -285,12 +430,7 @@ inline void Group::updateContentsRect(NVGcontext* vg) {
 }
 
 inline void Group::rearrange(NVGcontext* vg, autoscale_t scaling) {
-	{
-		std::unique_lock<std::mutex> lock(_childMutex);
-		for( auto c: _children ) if( c ) {
-			if( c->changed() ) c->reform(vg,autoscale_t::ALL);
-		}
-	}
+	reformChangedChildren(vg);
 	if( changed() ) {
 		rearrangeChildren(vg, paddedRect(),scaling );
 		Widget::rearrange(vg,scaling);
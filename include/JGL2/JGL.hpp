@@ -36,5 +36,6 @@
 //#include "MultiImageViewer.hpp"
 #include <JGL2/_NVAPIWrapper.hpp>
 #include <JGL2/Tabular.hpp>
+#include <JGL2/VirtualList.hpp>
 
 #endif /* JGL_h */
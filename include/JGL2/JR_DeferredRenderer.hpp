@@ -0,0 +1,205 @@
+//
+//  JR_DeferredRenderer.hpp
+//  JGL2
+//
+
+#ifndef _JR_DeferredRenderer_h
+#define _JR_DeferredRenderer_h
+
+#include "JR_Renderer.hpp"
+
+namespace JR {
+
+extern const std::string __gbuffer_frag_code__;
+extern const std::string __deferred_frag_header__;
+extern const std::string __deferred_frag_main__;
+extern const std::string __deferred_frag_code__;
+
+// Writes normal, albedo, ARM, F0 and depth into a G-buffer, then evaluates lighting,
+// shadowing and ambient once per pixel in a full-screen pass.
+// Lights, shadows and clusters are shared with PBRRenderer.
+struct DeferredRenderer: PBRRenderer {
+	DeferredRenderer();
+	virtual 		void			render(const sz2_t& sz, Camera& c) override;
+	static	inline	Program&		getGBufferProg();
+	static	inline	Program&		getResolveProg();
+
+protected:
+	virtual inline	void	geometryPass(const Camera& c);
+	virtual inline	void	resolvePass(const Camera& c);
+};
+
+inline DeferredRenderer::DeferredRenderer(): PBRRenderer() {
+}
+
+inline void DeferredRenderer::geometryPass(const Camera& camera) {
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	GLfloat oldClear[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClear);
+	GLboolean oldBlend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+
+	Program& gbufferProg = getGBufferProg();
+	camera.setUniforms(gbufferProg.progId);
+	gbufferProg.setUniform("color",		vec4(.8,.8,.8,1) );
+	gbufferProg.setUniform("modelMat",	mat4(1));
+	ivec2 sz = internalSize(vp);
+	_view->gbuffer.create(sz.x,sz.y);
+	_view->gbuffer.setToTarget();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	_staticFunc();
+	_renderFunc();
+	_view->gbuffer.restoreVP();
+
+	glClearColor(oldClear[0],oldClear[1],oldClear[2],oldClear[3]);
+	if( oldBlend ) glEnable(GL_BLEND);
+}
+
+inline void DeferredRenderer::resolvePass(const Camera& camera) {
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	Program& resolveProg = getResolveProg();
+	camera.setUniforms(resolveProg.progId);
+	resolveProg.setUniform("invViewProj", inverse(camera.projMat()*camera.viewMat()) );
+	resolveProg.setUniform("gViewport", vec4(vp[0],vp[1],vp[2],vp[3]) );
+	resolveProg.setUniform("linearOutput", _hdr?1:0 );
+	setLightingUniforms(resolveProg, camera);
+	_view->gbuffer.bindColor( resolveProg.progId, "gAlbedo", 0 );
+	_view->gbuffer.bindNormal( resolveProg.progId, "gNormal", 1 );
+	_view->gbuffer.bindARM( resolveProg.progId, "gARM", 2 );
+	_view->gbuffer.bindDepth( resolveProg.progId, "gDepth", 3 );
+	_view->gbuffer.bindF0( resolveProg.progId, "gF0", 4 );
+
+	// The resolve pass writes the G-buffer depth, so the wire pass and later GL drawing still depth test
+	glDepthFunc(GL_ALWAYS);
+	drawFullscreenTriangle();
+	glDepthFunc(GL_LEQUAL);
+}
+
+inline void DeferredRenderer::render(const sz2_t& sz, Camera& camera) {
+	JGL2_PROFILE_ZONE("DeferredRenderer::render");
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	camera.viewport(sz);
+	prepareFrame(camera);
+	_passTimer.begin("penumbra");
+	shadowClassPass(camera);
+	_passTimer.end();
+	_passTimer.begin("gbuffer");
+	geometryPass(camera);
+	_passTimer.end();
+	_passTimer.begin("ssao");
+	ssaoPass(camera, _view->gbuffer);
+	_passTimer.end();
+	beginHDR();
+	_passTimer.begin("resolve");
+	resolvePass(camera);
+	_passTimer.end();
+	_passTimer.begin("post");
+	endHDR();
+	_passTimer.end();
+	// After the post pass, as in PBRRenderer::render
+	_passTimer.begin("wire");
+	wirePass(camera);
+	_passTimer.end();
+	_governor.endFrame();
+	_passTimer.endFrame();
+}
+
+inline Program& DeferredRenderer::getGBufferProg() {
+	static AutoBuildProgram _gbufferProg = {__shader_vert_code__, __gbuffer_frag_code__};
+	_gbufferProg.use();
+	return _gbufferProg;
+}
+
+inline Program& DeferredRenderer::getResolveProg() {
+	static AutoBuildProgram _resolveProg = {__fullscreen_vert_code__, __deferred_frag_code__};
+	_resolveProg.use();
+	return _resolveProg;
+}
+
+
+
+const std::string __gbuffer_frag_code__ =
+"#version 410 core\n"
+"const float PI = 3.1415926;\n"
+"in vec3 worldPos;\n"
+"in vec3 normal;\n"
+"in vec2 texCoord;\n"
+"layout(location=0) out vec4 out_Albedo;\n"
+"layout(location=1) out vec4 out_Normal;\n"
+"layout(location=2) out vec4 out_ARM;\n"
+"layout(location=3) out vec4 out_F0;\n"
+"uniform vec3  cameraPos;\n"
++ __shader_frag_normal__
++ __shader_frag_material__ +
+"void main(void) {\n"
+"	vec3 f0, arm;\n"
+"	vec4 color = computeMaterial( arm, f0 );\n"
+"	out_Albedo = color;\n"
+"	out_Normal = vec4( computeNormal(), 1 );\n"
+"	out_ARM = vec4( arm, 1 );\n"
+"	out_F0 = vec4( f0, 1 );\n"
+"}\n";
+
+// The forward snippets read worldPos/normal/shadowCoord as inputs; here they
+// are globals reconstructed from the G-buffer before lighting is evaluated
+const std::string __deferred_frag_header__ =
+"#version 410 core\n"
+"#define MAX_N_LIGHTS 2\n"
+"#define SHADOW_COORD_DECLARED\n"
+"const float PI = 3.1415926;\n"
+"vec3 worldPos;\n"
+"vec3 normal;\n"
+"vec2 texCoord;\n"
+"vec4 shadowCoord[MAX_N_LIGHTS];\n"
+"out vec4 out_Color;\n"
+"uniform vec3  cameraPos;\n"
+"uniform sampler2D gAlbedo;\n"
+"uniform sampler2D gNormal;\n"
+"uniform sampler2D gARM;\n"
+"uniform sampler2D gF0;\n"
+"uniform sampler2D gDepth;\n"
+"uniform mat4  invViewProj;\n"
+"uniform vec4  gViewport;\n"
+"uniform mat4  shadowBiasedVP[MAX_N_LIGHTS];\n";
+
+const std::string __deferred_frag_main__ =
+"void main(void) {\n"
+"	vec2 uv = (gl_FragCoord.xy-gViewport.xy)/gViewport.zw;\n"
+"	float depth = texture( gDepth, uv ).r;\n"
+"	if( depth>=1 ) discard;\n"
+"	vec4 p = invViewProj*vec4( vec3(uv,depth)*2-1, 1 );\n"
+"	worldPos = p.xyz/p.w;\n"
+"	for( int i=0; i<MAX_N_LIGHTS; i++ ) shadowCoord[i] = shadowBiasedVP[i]*vec4( worldPos, 1 );\n"
+"	vec3 N = normalize( texture( gNormal, uv ).xyz );\n"
+"	normal = N;\n"
+"	vec4 color = texture( gAlbedo, uv );\n"
+"	vec3 arm = texture( gARM, uv ).rgb, f0 = texture( gF0, uv ).rgb, c = vec3(0);\n"
+"	vec3 V = normalize(cameraPos-worldPos);\n"
+"	for( int i=0; i<nLights; i++ ) {\n"
+"		float shadowing = computeShadowing( i, normalize(lights[i].pos-worldPos), normal );\n"
+"		c += computePointLighting(N, V, color.rgb, arm, f0, i ) * shadowing;\n"
+"	}\n"
+"	c += computeClusteredLighting(N, V, color.rgb, arm, f0 );\n"
+"	float ambOcc = computeAmbOcc()*arm.r;\n"
+"	vec3 am = computeAmbient( N, V, color.rgb, arm, f0 )*ambOcc;\n"
+"	out_Color = vec4( computeTonemap( c+am ), color.a);\n"
+"	gl_FragDepth = depth;\n"
+"}\n";
+
+const std::string __deferred_frag_code__ =
+__deferred_frag_header__
++ __shader_frag_tonemap__
++ __shader_frag_ambient_IBL__
++ __shader_frag_lighting_point_PBR__
++ __shader_frag_lighting_clustered__
++ __shader_frag_shadow_PCSS__
++ __shader_frag_ambOcc_SSAO__
++ __deferred_frag_main__;
+
+} // namespace JR
+
+#endif /* _JR_DeferredRenderer_h */
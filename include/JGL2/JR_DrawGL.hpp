@@ -14,7 +14,13 @@
 #endif
 
 #include <JGL2/JR_GLProgram.hpp>
+#include <GLFW/glfw3.h>
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace JR {
 
@@ -274,8 +280,83 @@ inline Program& blitProgram() {
 
 
 
+// Registry of every PerContext, so that a context going away (see
+// JGL2::_JGL::addContextReleaser) drops its entries in all of them
+struct PerContextBase {
+	inline					PerContextBase();
+	virtual inline			~PerContextBase();
+	virtual void			release( GLFWwindow* ctx ) = 0;
+	static inline void		releaseAll( GLFWwindow* ctx );
+protected:
+	// Each thread caches the objects it found for its current context, one slot per
+	// instance; a release bumps the epoch so that no cache keeps a destroyed entry
+	struct ThreadCache {
+		GLFWwindow*			ctx = nullptr;
+		uint64_t			epoch = 0;
+		std::vector<void*>	objects;
+	};
+	static inline ThreadCache&				threadCache() { static thread_local ThreadCache c; return c; }
+	static inline std::atomic<uint64_t>&	epoch() { static std::atomic<uint64_t> e{1}; return e; }
+	static inline std::mutex&				registryMutex() { static std::mutex m; return m; }
+	static inline std::vector<PerContextBase*>& registry() { static std::vector<PerContextBase*> r; return r; }
+	size_t					_slot;
+};
+
+inline PerContextBase::PerContextBase() {
+	static bool hooked = ( JGL2::_JGL::addContextReleaser( &PerContextBase::releaseAll ), true );
+	(void)hooked;
+	static std::atomic<size_t> nextSlot{0};
+	_slot = nextSlot++;
+	std::unique_lock<std::mutex> lock(registryMutex());
+	registry().push_back( this );
+}
+
+inline PerContextBase::~PerContextBase() {
+	std::unique_lock<std::mutex> lock(registryMutex());
+	auto& r = registry();
+	r.erase( std::remove( r.begin(), r.end(), this ), r.end() );
+}
+
+inline void PerContextBase::releaseAll( GLFWwindow* ctx ) {
+	std::unique_lock<std::mutex> lock(registryMutex());
+	for( auto p: registry() ) p->release( ctx );
+	epoch()++;
+}
+
+// One T per GL context. Vertex arrays are not shared between contexts (other windows,
+// the render thread), so helpers that keep one around keep it here, keyed by the
+// context current at the call. Only the first get() per thread and context locks;
+// the entry is destroyed, with its context current, when the context is
+template<typename T>
+struct PerContext : PerContextBase {
+	inline T&		get() {
+		ThreadCache& c = threadCache();
+		GLFWwindow* ctx = glfwGetCurrentContext();
+		uint64_t e = epoch().load();
+		if( c.ctx!=ctx || c.epoch!=e ) {
+			c.ctx = ctx;
+			c.epoch = e;
+			c.objects.clear();
+		}
+		if( _slot<c.objects.size() && c.objects[_slot] ) return *static_cast<T*>( c.objects[_slot] );
+		std::unique_lock<std::mutex> lock(_mutex);
+		T& obj = _objects[ctx];
+		if( c.objects.size()<=_slot ) c.objects.resize( _slot+1, nullptr );
+		c.objects[_slot] = &obj;
+		return obj;
+	}
+	virtual void	release( GLFWwindow* ctx ) override {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_objects.erase( ctx );
+	}
+protected:
+	std::mutex					_mutex;
+	std::map<GLFWwindow*,T>		_objects;
+};
+
 inline void drawScreenQuad() {
-	static RenderableMeshBase mesh;
+	static PerContext<RenderableMeshBase> meshes;
+	RenderableMeshBase& mesh = meshes.get();
 	if( !mesh.created() ) {
 		const std::vector<vec3>  v = { {0,1,0}, {0,0,0}, {1,1,0}, {1,0,0} };
 		const std::vector<vec3>  n = { {0,0,1}, {0,0,1}, {0,0,1}, {0,0,1} };
@@ -287,7 +368,8 @@ inline void drawScreenQuad() {
 }
 
 inline void drawQuad() {
-	static RenderableMeshBase mesh;
+	static PerContext<RenderableMeshBase> meshes;
+	RenderableMeshBase& mesh = meshes.get();
 	if( !mesh.created() ) {
 		const std::vector<vec3>  v = { {-1,1,0}, {-1,-1,0}, {1,1,0}, {1,-1,0} };
 		const std::vector<vec3>  n = { {0,0,1}, {0,0,1}, {0,0,1}, {0,0,1} };
@@ -303,7 +385,8 @@ const int N_SLICE = 30;
 
 inline void drawSphere() {
 	const float PI = 3.14159265f;
-	static RenderableMeshBase mesh;
+	static PerContext<RenderableMeshBase> meshes;
+	RenderableMeshBase& mesh = meshes.get();
 	if( !mesh.created() ) {
 		std::vector<vec3> v;
 		std::vector<vec2> t;
@@ -354,7 +437,8 @@ inline void drawSphere() {
 
 inline void drawCylinder() {
 	const float PI = 3.14159265f;
-	static RenderableMeshBase mesh;
+	static PerContext<RenderableMeshBase> meshes;
+	RenderableMeshBase& mesh = meshes.get();
 	if( !mesh.created() ) {
 		std::vector<vec3> v;
 		std::vector<vec3> n;
@@ -18,6 +18,7 @@
 namespace JR {
 
 struct FramebufferObj {
+	FramebufferObj( GLint format = GL_RGBA ): colorFormat(format) {}
 	static void setTexParam( GLuint minFilter = GL_LINEAR, GLuint warp = GL_CLAMP_TO_EDGE ) {
 		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
@@ -27,6 +28,8 @@ struct FramebufferObj {
 	virtual size_t w() const { return _w; }
 	virtual size_t h() const { return _h; }
 	virtual bool   valid() const { return fbo>0; }
+	virtual GLuint colorTex() const { return color; }
+	virtual GLuint depthTex() const { return depth; }
 
 	virtual void clearGL() {
 		if( color ) glDeleteTextures( 1, &color ); color = 0;
@@ -40,7 +43,7 @@ struct FramebufferObj {
 		clearGL();
 		glGenTextures( 1, &color );
 		glBindTexture( GL_TEXTURE_2D, color );
-		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, ww, hh, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		glTexImage2D( GL_TEXTURE_2D, 0, colorFormat, ww, hh, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
 		setTexParam();
 		
 		glGenTextures( 1, &depth );
@@ -73,6 +76,16 @@ struct FramebufferObj {
 		if( oldSc )
 			glEnable(GL_SCISSOR_TEST);
 	}
+	virtual void copyDepthFrom( const FramebufferObj& src ) {
+		GLint oldRead, oldDraw;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldRead );
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldDraw );
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, src.fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+		glBlitFramebuffer(0, 0, (int)src._w, (int)src._h, 0, 0, (int)_w, (int)_h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, oldRead);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldDraw);
+	}
 	virtual void bindColor( GLuint prog, const std::string& name, GLuint slot ) {
 		glActiveTexture( GL_TEXTURE0+slot );
 		glBindTexture( GL_TEXTURE_2D, color );
@@ -84,6 +97,7 @@ struct FramebufferObj {
 		glUniform1i( glGetUniformLocation(prog,name.c_str()), (int)slot );
 	}
 protected:
+	GLint  colorFormat;
 	size_t _w = 0;
 	size_t _h = 0;
 	GLuint fbo = 0;
@@ -94,6 +108,98 @@ protected:
 	GLint oldFB, oldSc;
 };
 
+// Geometry buffer for deferred shading: albedo (RGBA8), world normal (RGBA16F),
+// ARM + F0 (RGBA8) and depth
+struct GBufferObj: FramebufferObj {
+	virtual void clearGL() override {
+		if( normal ) { glDeleteTextures( 1, &normal ); normal = 0; }
+		if( arm    ) { glDeleteTextures( 1, &arm    ); arm = 0; }
+		if( f0     ) { glDeleteTextures( 1, &f0     ); f0 = 0; }
+		FramebufferObj::clearGL();
+	}
+	virtual void create( int ww, int hh ) override {
+		if( ww == _w && hh == _h ) return;
+		_w = (unsigned long)ww;
+		_h = (unsigned long)hh;
+		clearGL();
+		color  = createTex( GL_RGBA8,   GL_RGBA, GL_UNSIGNED_BYTE );
+		normal = createTex( GL_RGBA16F, GL_RGBA, GL_FLOAT );
+		arm    = createTex( GL_RGBA8,   GL_RGBA, GL_UNSIGNED_BYTE );
+		f0     = createTex( GL_RGBA8,   GL_RGBA, GL_UNSIGNED_BYTE );
+		depth  = createTex( GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT );
+		
+		glGenFramebuffers( 1, &fbo );
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFB );
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color, 0);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, normal, 0);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, arm, 0);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, f0, 0);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0 );
+		const GLenum bufs[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+		glDrawBuffers( 4, bufs );
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr<<"G-buffer is incomplete";
+		glBindFramebuffer(GL_FRAMEBUFFER, oldFB);
+	}
+	virtual void bindNormal( GLuint prog, const std::string& name, GLuint slot ) { bindTex( prog, name, slot, normal ); }
+	virtual void bindARM( GLuint prog, const std::string& name, GLuint slot ) { bindTex( prog, name, slot, arm ); }
+	virtual void bindF0( GLuint prog, const std::string& name, GLuint slot ) { bindTex( prog, name, slot, f0 ); }
+protected:
+	GLuint createTex( GLenum internalFormat, GLenum format, GLenum type ) {
+		GLuint tex;
+		glGenTextures( 1, &tex );
+		glBindTexture( GL_TEXTURE_2D, tex );
+		glTexImage2D( GL_TEXTURE_2D, 0, internalFormat, (int)_w, (int)_h, 0, format, type, 0);
+		setTexParam( GL_NEAREST );
+		return tex;
+	}
+	static void bindTex( GLuint prog, const std::string& name, GLuint slot, GLuint tex ) {
+		glActiveTexture( GL_TEXTURE0+slot );
+		glBindTexture( GL_TEXTURE_2D, tex );
+		glUniform1i( glGetUniformLocation(prog,name.c_str()), (int)slot );
+	}
+	GLuint normal = 0;
+	GLuint arm = 0;
+	GLuint f0 = 0;		// Specular color, kept in RGB so tinted specTex survives
+};
+
+// Depth-only cube map, attached as a layered target so that all six faces
+// can be rendered in a single pass (gl_Layer selects the face)
+struct CubeDepthFramebufferObj: FramebufferObj {
+	virtual void create( int ww, int hh ) override {
+		if( ww == _w && hh == _h ) return;
+		_w = (unsigned long)ww;
+		_h = (unsigned long)hh;
+		clearGL();
+		glGenTextures( 1, &depth );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, depth );
+		for( int f=0; f<6; f++ )
+			glTexImage2D( GL_TEXTURE_CUBE_MAP_POSITIVE_X+f, 0, GL_DEPTH_COMPONENT32F, ww, hh, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+		glTexParameteri( GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE );
+
+		glGenFramebuffers( 1, &fbo );
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFB );
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferTexture( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0 );
+		glDrawBuffer( GL_NONE );
+		glReadBuffer( GL_NONE );
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cerr<<"Cube FBO is incomplete";
+		glBindFramebuffer(GL_FRAMEBUFFER, oldFB);
+	}
+	virtual void create( int sz ) { create( sz, sz ); }
+	virtual void bindDepth( GLuint prog, const std::string& name, GLuint slot ) override {
+		glActiveTexture( GL_TEXTURE0+slot );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, depth );
+		glUniform1i( glGetUniformLocation(prog,name.c_str()), (int)slot );
+	}
+};
+
 } // namespace JR
 
 #endif /* _JR_FramebufferObj_hpp */
@@ -174,6 +174,7 @@ struct Program {
 		if( progId ) glDeleteProgram( progId );	progId = 0;
 		if( vertId ) glDeleteShader( vertId );	vertId = 0;
 		if( fragId ) glDeleteShader( fragId );	fragId = 0;
+		if( geomId ) glDeleteShader( geomId );	geomId = 0;
 	}
 	virtual bool isUsable() const { return progId>0; }
 	virtual void use() const { if( progId>0 ) glUseProgram( progId ); }
@@ -182,8 +183,10 @@ struct Program {
 	GLuint progId = 0;
 	GLuint vertId = 0;
 	GLuint fragId = 0;
+	GLuint geomId = 0;
 
 	virtual void create( const str_t& vertSrc, const str_t& fragSrc );
+	virtual void create( const str_t& vertSrc, const str_t& geomSrc, const str_t& fragSrc );
 	virtual void load( const std::filesystem::path& vertFn, const std::filesystem::path& fragFn );
 	
 	void setUniform( const str_t& loc, const int& v )	{ use(); JR::setUniform( progId, loc, v ); }
@@ -237,7 +240,8 @@ inline GLuint Program::compileShader( GLenum shaderType, const str_t& src) {
 	glGetShaderiv( shader, GL_COMPILE_STATUS, &success );
 	if( !success ) {
 		glGetShaderInfoLog( shader, 512, NULL, infoLog );
-		fprintf( stderr, "%s", (shaderType ==GL_VERTEX_SHADER) ? "Vertex ":"Fragment " );
+		fprintf( stderr, "%s", (shaderType ==GL_VERTEX_SHADER) ? "Vertex "
+						: (shaderType ==GL_GEOMETRY_SHADER) ? "Geometry ":"Fragment " );
 		fprintf( stderr, "error:\n" );
 		fprintf( stderr, "%s\n", infoLog );
 	}
@@ -245,11 +249,19 @@ inline GLuint Program::compileShader( GLenum shaderType, const str_t& src) {
 }
 
 inline void Program::create( const str_t& vertSrc, const str_t& fragSrc ) {
+	create( vertSrc, "", fragSrc );
+}
+
+inline void Program::create( const str_t& vertSrc, const str_t& geomSrc, const str_t& fragSrc ) {
    vertId = compileShader( GL_VERTEX_SHADER, vertSrc );
+   if( geomSrc.length()>0 )
+	   geomId = compileShader( GL_GEOMETRY_SHADER, geomSrc );
    fragId = compileShader( GL_FRAGMENT_SHADER, fragSrc );
 
    progId = glCreateProgram();
    glAttachShader( progId, vertId );
+   if( geomId )
+	   glAttachShader( progId, geomId );
    glAttachShader( progId, fragId );
    glLinkProgram( progId);
 
@@ -274,11 +286,14 @@ inline void Program::load( const std::filesystem::path& vertFn, const std::files
 
 struct AutoBuildProgram : Program {
 	str_t vertSrc;
+	str_t geomSrc;
 	str_t fragSrc;
 	AutoBuildProgram( const str_t& vSrc, const str_t& fSrc)
 	: vertSrc(vSrc), fragSrc(fSrc){}
+	AutoBuildProgram( const str_t& vSrc, const str_t& gSrc, const str_t& fSrc)
+	: vertSrc(vSrc), geomSrc(gSrc), fragSrc(fSrc){}
 	virtual void use() {
-		if( progId<1 ) create( vertSrc, fragSrc );
+		if( progId<1 ) create( vertSrc, geomSrc, fragSrc );
 		Program::use();
 	}
 };
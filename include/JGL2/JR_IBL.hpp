@@ -0,0 +1,460 @@
+//
+//  JR_IBL.hpp
+//  JGL2
+//
+
+#ifndef JR_IBL_h
+#define JR_IBL_h
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace JR {
+
+extern const std::string __fullscreen_vert_code__;
+extern const std::string __ibl_common_code__;
+extern const std::string __ibl_prefilter_frag_code__;
+extern const std::string __ibl_brdf_frag_code__;
+inline void drawFullscreenTriangle();
+
+// Image based lighting from an equirectangular PFM. Precomputes
+//  - SH9 irradiance on the CPU, in the basis of evalSphericalHarmonic()
+//  - a GGX prefiltered radiance chain, roughness k/(levels-1) at mip k (array layer 0)
+//  - the split-sum BRDF LUT, (NoV,roughness) -> (scale,bias) at mip 0 of array layer 1
+// so that the whole thing needs one texture unit. Results are cached in cacheDir,
+// keyed by the file's path, size and modification time and CACHE_VERSION, so that a
+// cached environment is never read; the LUT is shared by all environments.
+// load() is decode() (CPU only, any thread) followed by upload().
+struct EnvironmentMap {
+	// Bump whenever the layout or the math behind the cache files changes
+	static constexpr int CACHE_VERSION = 2;
+
+	int		size = 512;				// Width of the prefiltered map, height is size/2
+	int		levels = 6;
+	int		samples = 256;
+	float	intensity = 1.f;
+
+	// The SH9 of a file and either its cached prefiltered chain or the image to prefilter
+	struct Decoded {
+		bool					ok = false;
+		std::filesystem::path	cacheFile;
+		vec3					sh[9];
+		std::vector<float>		cache;		// SH9 then the levels of layer 0, when cached
+		int						w = 0, h = 0, c = 0;
+		std::unique_ptr<float[]> image;		// Otherwise the decoded PFM
+	};
+
+	virtual inline bool			load( const std::filesystem::path& fn, const std::filesystem::path& cacheDir = defaultCacheDir() );
+	static	inline Decoded		decode( const std::filesystem::path& fn, int size, int levels, int samples,
+									   const std::filesystem::path& cacheDir = defaultCacheDir() );
+	// Needs a GL context; samples is taken from this map, size and levels must match d
+	virtual inline bool			upload( Decoded& d, const std::filesystem::path& cacheDir = defaultCacheDir() );
+	virtual inline bool			valid() const { return _tex>0; }
+	virtual inline const vec3*	shCoeff() const { return _sh; }
+	virtual inline void			bind( GLuint prog, GLuint slot );
+	virtual inline void			clearGL();
+
+	static	inline std::filesystem::path	defaultCacheDir() { return std::filesystem::temp_directory_path()/"JGL2_IBL"; }
+	// Rows are split over JGL2::_JGL::threadPool()
+	static	inline void			computeSH9( int w, int h, int c, const float* data, vec3 sh[9] );
+	// Binary PFM ("PF" RGB, "Pf" grey) held in bytes, rows flipped to top-down
+	static	inline bool			decodePFM( const std::string& bytes, int& w, int& h, int& c, std::unique_ptr<float[]>& image );
+	static	inline uint64_t		hash( const void* data, size_t n, uint64_t h = 14695981039346656037ULL );
+	static	inline Program&		getPrefilterProg();
+	static	inline Program&		getBRDFProg();
+
+protected:
+	virtual inline void			allocate();
+	virtual inline void			prefilter( int w, int h, int c, const float* data );
+	virtual inline void			integrateBRDF();
+	virtual inline void			renderLayer( Program& prog, int level, int layer );
+	virtual inline void			readLayer( int level, int layer, std::vector<float>& out ) const;
+	virtual inline void			writeLayer( int level, int layer, const float* data );
+	static	inline bool			readCache( const std::filesystem::path& fn, std::vector<float>& data );
+	static	inline void			writeCache( const std::filesystem::path& fn, const std::vector<float>& data );
+	static	inline size_t		chainSize( int size, int levels );
+
+	GLuint	_tex = 0;
+	vec3	_sh[9];
+};
+
+inline uint64_t EnvironmentMap::hash( const void* data, size_t n, uint64_t h ) {
+	// FNV-1a
+	const unsigned char* p = (const unsigned char*)data;
+	for( size_t i=0; i<n; i++ ) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+// A fixed number of row chunks, each with its own partial sums added up in order, so
+// that the result does not depend on how many threads ran them
+inline void EnvironmentMap::computeSH9( int w, int h, int c, const float* data, vec3 sh[9] ) {
+	const float pi = 3.14159265f;
+	std::vector<float> sinPhi( w ), cosPhi( w );
+	for( int x=0; x<w; x++ ) {
+		float phi = (x+.5f)/w*2*pi;
+		sinPhi[x] = sinf( phi );
+		cosPhi[x] = cosf( phi );
+	}
+	int nChunks = std::max( 1, std::min( h, 64 ) );
+	std::vector<float> partial( nChunks*27, 0.f );
+	JGL2::_JGL::threadPool().parallelFor( nChunks, [&]( int t ) {
+		float* out = partial.data()+t*27;
+		for( int y=h*t/nChunks; y<h*(t+1)/nChunks; y++ ) {
+			float theta = (1-(y+.5f)/h)*pi;
+			float st = sinf( theta ), ct = cosf( theta );
+			float dOmega = (2*pi/w)*(pi/h)*st;
+			const float* row = data+size_t(y)*w*c;
+			float acc[27] = {};
+			for( int x=0; x<w; x++ ) {
+				float dx = st*sinPhi[x], dy = ct, dz = -st*cosPhi[x];
+				float basis[9] = { 1, dy, dz, dx, dx*dy, dy*dz, dz*dz-1/3.f, dx*dz, dx*dx-dy*dy };
+				const float* p = row+size_t(x)*c;
+				float r = p[0], g = p[c>1?1:0], b = p[c>2?2:0];
+				for( int k=0; k<9; k++ ) {
+					acc[k*3  ] += basis[k]*r;
+					acc[k*3+1] += basis[k]*g;
+					acc[k*3+2] += basis[k]*b;
+				}
+			}
+			for( int k=0; k<27; k++ ) out[k] += acc[k]*dOmega;
+		}
+	} );
+
+	// Y_lm = cY*basis; irradiance/pi = sum A_l/pi*L_lm*Y_lm, L_lm = sum radiance*Y_lm*dOmega
+	const float cY[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.946176f, 1.092548f, 0.546274f };
+	const float A[9]  = { 1, 2/3.f, 2/3.f, 2/3.f, .25f, .25f, .25f, .25f, .25f };
+	for( int k=0; k<9; k++ ) {
+		vec3 s( 0 );
+		for( int t=0; t<nChunks; t++ )
+			s += vec3( partial[t*27+k*3], partial[t*27+k*3+1], partial[t*27+k*3+2] );
+		sh[k] = s*cY[k]*cY[k]*A[k];
+	}
+}
+
+inline bool EnvironmentMap::decodePFM( const std::string& bytes, int& w, int& h, int& c, std::unique_ptr<float[]>& image ) {
+	if( bytes.size()<3 || bytes[0]!='P' || ( bytes[1]!='F' && bytes[1]!='f' ) ) return false;
+	c = bytes[1]=='F' ? 3 : 1;
+	std::istringstream header( bytes.substr( 2, 256 ) );
+	float scale = 0;
+	header >> w >> h >> scale;
+	if( !header || w<1 || h<1 ) return false;
+	// A single whitespace character follows the scale
+	size_t offset = 2+size_t( header.tellg() )+1;
+	size_t rowFloats = size_t(w)*c, n = rowFloats*h;
+	if( bytes.size()<offset+n*sizeof(float) ) return false;
+	image.reset( new float[n] );
+	// Rows are stored bottom-up; a positive scale means big endian
+	for( int y=0; y<h; y++ ) {
+		float* dst = image.get()+size_t(y)*rowFloats;
+		memcpy( dst, bytes.data()+offset+size_t(h-1-y)*rowFloats*sizeof(float), rowFloats*sizeof(float) );
+		if( scale>0 ) {
+			for( size_t i=0; i<rowFloats; i++ ) {
+				uint32_t v;
+				memcpy( &v, dst+i, 4 );
+				v = (v>>24)|((v>>8)&0xff00)|((v<<8)&0xff0000)|(v<<24);
+				memcpy( dst+i, &v, 4 );
+			}
+		}
+	}
+	return true;
+}
+
+inline bool EnvironmentMap::readCache( const std::filesystem::path& fn, std::vector<float>& data ) {
+	std::ifstream ifs( fn, std::ios::binary );
+	if( !ifs.is_open() ) return false;
+	uint64_t n = 0;
+	ifs.read( (char*)&n, sizeof(n) );
+	if( !ifs || n!=data.size() ) return false;
+	ifs.read( (char*)data.data(), std::streamsize( n*sizeof(float) ) );
+	return bool( ifs );
+}
+
+inline void EnvironmentMap::writeCache( const std::filesystem::path& fn, const std::vector<float>& data ) {
+	std::error_code ec;
+	std::filesystem::create_directories( fn.parent_path(), ec );
+	std::ofstream ofs( fn, std::ios::binary );
+	if( !ofs.is_open() ) return;
+	uint64_t n = data.size();
+	ofs.write( (const char*)&n, sizeof(n) );
+	ofs.write( (const char*)data.data(), std::streamsize( n*sizeof(float) ) );
+}
+
+inline void EnvironmentMap::allocate() {
+	clearGL();
+	glGenTextures( 1, &_tex );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, _tex );
+	for( int l=0; l<levels; l++ )
+		glTexImage3D( GL_TEXTURE_2D_ARRAY, l, GL_RGBA16F, std::max(1,size>>l), std::max(1,size/2>>l), 2, 0, GL_RGBA, GL_FLOAT, 0 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels-1 );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+}
+
+inline void EnvironmentMap::readLayer( int level, int layer, std::vector<float>& out ) const {
+	size_t n = size_t( std::max(1,size>>level) )*std::max(1,size/2>>level)*4;
+	std::vector<float> both( n*2 );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, _tex );
+	glGetTexImage( GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_FLOAT, both.data() );
+	out.insert( out.end(), both.begin()+n*layer, both.begin()+n*(layer+1) );
+}
+
+inline void EnvironmentMap::writeLayer( int level, int layer, const float* data ) {
+	glBindTexture( GL_TEXTURE_2D_ARRAY, _tex );
+	glTexSubImage3D( GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, std::max(1,size>>level), std::max(1,size/2>>level), 1, GL_RGBA, GL_FLOAT, data );
+}
+
+inline void EnvironmentMap::renderLayer( Program& prog, int level, int layer ) {
+	int w = std::max(1,size>>level), h = std::max(1,size/2>>level);
+	GLint oldFB, oldVP[4];
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &oldFB );
+	glGetIntegerv( GL_VIEWPORT, oldVP );
+	GLuint fbo;
+	glGenFramebuffers( 1, &fbo );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, fbo );
+	glFramebufferTextureLayer( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _tex, level, layer );
+	glViewport( 0, 0, w, h );
+	prog.setUniform( "dstSize", vec2( w, h ) );
+	drawFullscreenTriangle();
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, oldFB );
+	glViewport( oldVP[0], oldVP[1], oldVP[2], oldVP[3] );
+	glDeleteFramebuffers( 1, &fbo );
+}
+
+inline void EnvironmentMap::prefilter( int w, int h, int c, const float* data ) {
+	std::vector<float> rgb( size_t(w)*h*3 );
+	for( size_t i=0; i<size_t(w)*h; i++ )
+		for( int k=0; k<3; k++ )
+			rgb[i*3+k] = data[i*c+std::min( k, c-1 )];
+	GLuint src;
+	glGenTextures( 1, &src );
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, src );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB32F, w, h, 0, GL_RGB, GL_FLOAT, rgb.data() );
+	glGenerateMipmap( GL_TEXTURE_2D );
+	FramebufferObj::setTexParam( GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+	Program& prog = getPrefilterProg();
+	prog.setUniform( "srcTex", 0 );
+	prog.setUniform( "srcSize", vec2( w, h ) );
+	prog.setUniform( "nSamples", samples );
+	for( int l=0; l<levels; l++ ) {
+		prog.setUniform( "roughness", levels>1?l/float(levels-1):0.f );
+		renderLayer( prog, l, 0 );
+	}
+	glDeleteTextures( 1, &src );
+}
+
+inline void EnvironmentMap::integrateBRDF() {
+	Program& prog = getBRDFProg();
+	prog.setUniform( "nSamples", samples );
+	renderLayer( prog, 0, 1 );
+}
+
+inline bool EnvironmentMap::load( const std::filesystem::path& fn, const std::filesystem::path& cacheDir ) {
+	Decoded d = decode( fn, size, levels, samples, cacheDir );
+	return upload( d, cacheDir );
+}
+
+// Floats in the prefiltered levels of one array layer
+inline size_t EnvironmentMap::chainSize( int size, int levels ) {
+	size_t total = 0;
+	for( int l=0; l<levels; l++ )
+		total += size_t( std::max(1,size>>l) )*std::max(1,size/2>>l)*4;
+	return total;
+}
+
+inline EnvironmentMap::Decoded EnvironmentMap::decode( const std::filesystem::path& fn, int size, int levels, int samples,
+													   const std::filesystem::path& cacheDir ) {
+	Decoded d;
+	std::error_code ec;
+	std::string path = std::filesystem::absolute( fn, ec ).string();
+	uint64_t fileSize = std::filesystem::file_size( fn, ec );
+	if( ec ) return d;
+	int64_t mtime = int64_t( std::filesystem::last_write_time( fn, ec ).time_since_epoch().count() );
+	int params[4] = { CACHE_VERSION, size, levels, samples };
+	uint64_t key = hash( path.data(), path.size() );
+	key = hash( &fileSize, sizeof(fileSize), key );
+	key = hash( &mtime, sizeof(mtime), key );
+	key = hash( params, sizeof(params), key );
+	char name[64];
+	snprintf( name, 64, "%016llx.ibl", (unsigned long long)key );
+	d.cacheFile = cacheDir/name;
+
+	d.cache.resize( 27+chainSize( size, levels ) );
+	if( readCache( d.cacheFile, d.cache ) ) {
+		for( int k=0; k<9; k++ ) d.sh[k] = vec3( d.cache[k*3], d.cache[k*3+1], d.cache[k*3+2] );
+		d.ok = true;
+		return d;
+	}
+	d.cache.clear();
+	std::ifstream ifs( fn, std::ios::binary );
+	if( !ifs.is_open() ) return d;
+	std::string bytes( (std::istreambuf_iterator<char>( ifs )), std::istreambuf_iterator<char>() );
+	if( !decodePFM( bytes, d.w, d.h, d.c, d.image ) ) return d;
+	computeSH9( d.w, d.h, d.c, d.image.get(), d.sh );
+	d.ok = true;
+	return d;
+}
+
+inline bool EnvironmentMap::upload( Decoded& d, const std::filesystem::path& cacheDir ) {
+	if( !d.ok ) return false;
+	GLboolean oldBlend = glIsEnabled(GL_BLEND);
+	GLboolean oldDepth = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	allocate();
+
+	for( int k=0; k<9; k++ ) _sh[k] = d.sh[k];
+	if( !d.image ) {
+		size_t offset = 27;
+		for( int l=0; l<levels; l++ ) {
+			writeLayer( l, 0, d.cache.data()+offset );
+			offset += size_t( std::max(1,size>>l) )*std::max(1,size/2>>l)*4;
+		}
+	}
+	else {
+		prefilter( d.w, d.h, d.c, d.image.get() );
+		d.image.reset();
+		d.cache.clear();
+		for( int k=0; k<9; k++ ) d.cache.insert( d.cache.end(), { _sh[k].r, _sh[k].g, _sh[k].b } );
+		for( int l=0; l<levels; l++ ) readLayer( l, 0, d.cache );
+		writeCache( d.cacheFile, d.cache );
+	}
+
+	char name[64];
+	snprintf( name, 64, "brdf_v%d_%dx%d_%d.lut", CACHE_VERSION, size, size/2, samples );
+	std::vector<float> lut( size_t(size)*(size/2)*4 );
+	if( readCache( cacheDir/name, lut ) )
+		writeLayer( 0, 1, lut.data() );
+	else {
+		integrateBRDF();
+		lut.clear();
+		readLayer( 0, 1, lut );
+		writeCache( cacheDir/name, lut );
+	}
+	if( oldBlend ) glEnable(GL_BLEND);
+	if( oldDepth ) glEnable(GL_DEPTH_TEST);
+	return true;
+}
+
+inline void EnvironmentMap::bind( GLuint prog, GLuint slot ) {
+	// The sampler always gets its own unit, even when unused, so that it never
+	// aliases a sampler2D unit
+	glActiveTexture( GL_TEXTURE0+slot );
+	glBindTexture( GL_TEXTURE_2D_ARRAY, _tex );
+	setUniform( prog, "envMap", int(slot) );
+	setUniform( prog, "envEnabled", _tex>0?1:0 );
+	setUniform( prog, "envLevels", float(levels) );
+	setUniform( prog, "envIntensity", intensity );
+}
+
+inline void EnvironmentMap::clearGL() {
+	if( _tex ) { glDeleteTextures( 1, &_tex ); _tex = 0; }
+}
+
+inline Program& EnvironmentMap::getPrefilterProg() {
+	static AutoBuildProgram _prefilter_Prog = {__fullscreen_vert_code__, __ibl_prefilter_frag_code__};
+	_prefilter_Prog.use();
+	return _prefilter_Prog;
+}
+
+inline Program& EnvironmentMap::getBRDFProg() {
+	static AutoBuildProgram _brdf_Prog = {__fullscreen_vert_code__, __ibl_brdf_frag_code__};
+	_brdf_Prog.use();
+	return _brdf_Prog;
+}
+
+
+
+const std::string __ibl_common_code__ =
+"#version 410 core\n"
+"const float PI = 3.1415926;\n"
+"uniform vec2 dstSize;\n"
+"uniform int  nSamples = 256;\n"
+"out vec4 out_Color;\n"
+"vec2 hammersley( int i, int n ) {\n"
+"	return vec2( float(i)/float(n), float( bitfieldReverse( uint(i) ) )*2.3283064365386963e-10 );\n"
+"}\n"
+"vec3 sampleGGX( vec2 xi, vec3 N, float a2 ) {\n"
+"	float phi = 2*PI*xi.x;\n"
+"	float cosT = sqrt( (1-xi.y)/(1+(a2-1)*xi.y) );\n"
+"	float sinT = sqrt( 1-cosT*cosT );\n"
+"	vec3 T = normalize( cross( abs(N.y)<.999?vec3(0,1,0):vec3(1,0,0), N ) );\n"
+"	vec3 B = cross( N, T );\n"
+"	return T*(sinT*cos(phi))+B*(sinT*sin(phi))+N*cosT;\n"
+"}\n";
+
+// V=N=R approximation; samples come from a mip that matches the sample's solid angle
+const std::string __ibl_prefilter_frag_code__ =
+__ibl_common_code__ +
+"uniform sampler2D srcTex;\n"
+"uniform vec2  srcSize;\n"
+"uniform float roughness;\n"
+"vec3 equirectDir( vec2 uv ) {\n"
+"	float t = (1-uv.y)*PI, p = uv.x*2*PI;\n"
+"	return vec3( sin(t)*sin(p), cos(t), -sin(t)*cos(p) );\n"
+"}\n"
+"vec2 equirectUV( vec3 d ) {\n"
+"	return vec2( atan( d.x, -d.z )/(2*PI), 1-acos( clamp( d.y, -1, 1 ) )/PI );\n"
+"}\n"
+"void main(void) {\n"
+"	vec3 N = equirectDir( gl_FragCoord.xy/dstSize );\n"
+"	if( roughness<=0 ) { out_Color = vec4( textureLod( srcTex, equirectUV( N ), 0 ).rgb, 1 ); return; }\n"
+"	float a2 = roughness*roughness*roughness*roughness;\n"
+"	float saTexel = 4*PI/(srcSize.x*srcSize.y);\n"
+"	vec3 c = vec3(0);\n"
+"	float wsum = 0;\n"
+"	for( int i=0; i<nSamples; i++ ) {\n"
+"		vec3 H = sampleGGX( hammersley( i, nSamples ), N, a2 );\n"
+"		vec3 L = 2*dot( N, H )*H-N;\n"
+"		float NoL = dot( N, L );\n"
+"		if( NoL<=0 ) continue;\n"
+"		float NoH = dot( N, H );\n"
+"		float f = (NoH*a2-NoH)*NoH+1;\n"
+"		float pdf = a2/(PI*f*f)/4;\n"
+"		float lod = max( .5*log2( 1/(float(nSamples)*pdf*saTexel) )+1, 0 );\n"
+"		c += textureLod( srcTex, equirectUV( L ), lod ).rgb*NoL;\n"
+"		wsum += NoL;\n"
+"	}\n"
+"	out_Color = vec4( c/max( wsum, 1e-4 ), 1 );\n"
+"}\n";
+
+const std::string __ibl_brdf_frag_code__ =
+__ibl_common_code__ +
+"float G1( float x, float k ) { return x/(x*(1-k)+k); }\n"
+"void main(void) {\n"
+"	vec2 uv = (gl_FragCoord.xy-.5)/(dstSize-1);\n"
+"	float NoV = max( uv.x, 1e-3 );\n"
+"	float a = uv.y*uv.y;\n"
+"	vec3 V = vec3( sqrt( 1-NoV*NoV ), 0, NoV );\n"
+"	vec3 N = vec3( 0, 0, 1 );\n"
+"	vec2 ab = vec2(0);\n"
+"	for( int i=0; i<nSamples; i++ ) {\n"
+"		vec3 H = sampleGGX( hammersley( i, nSamples ), N, a*a );\n"
+"		vec3 L = 2*dot( V, H )*H-V;\n"
+"		float NoL = max( L.z, 0 ), NoH = max( H.z, 0 ), VoH = max( dot( V, H ), 0 );\n"
+"		if( NoL<=0 ) continue;\n"
+"		float G = G1( NoV, a/2 )*G1( NoL, a/2 );\n"
+"		float Gv = G*VoH/(NoH*NoV);\n"
+"		float Fc = pow( 1-VoH, 5 );\n"
+"		ab += vec2( 1-Fc, Fc )*Gv;\n"
+"	}\n"
+"	out_Color = vec4( ab/float(nSamples), 0, 1 );\n"
+"}\n";
+
+} // namespace JR
+
+#endif /* JR_IBL_h */
@@ -13,6 +13,8 @@ namespace JR {
 struct PointLight {
 	const float shadowZNear=100.f, shadowZFar=1000.f;
 	const float shadowFov = 1.0f;
+	const float shadowCubeZNear = 1.f;
+	const float rangeCutoff = 0.05f;
 	
 	PointLight( const vec3&	pos = {80,200,75}, const vec3& intensity = vec3(150000), float radius=3 )
 	:_pos(pos), _intensity(intensity), _radius(radius){}
@@ -22,21 +24,37 @@ struct PointLight {
 	virtual inline vec3&		intensity	() 				{ return _intensity; }
 	virtual inline float&		radius		() 				{ return _radius	; }
 	virtual inline bool&		enabled		() 				{ return _enabled  ; }
+	virtual inline bool&		omnidirectional()			{ return _omni		; }
 
 	virtual inline bool			shadowing	() const 		{ return _shadowing; }
 	virtual inline const vec3&	pos			() const 		{ return _pos		; }
 	virtual inline const vec3&	intensity	() const 		{ return _intensity; }
 	virtual inline float		radius		() const 		{ return _radius	; }
 	virtual inline bool			enabled		() const 		{ return _enabled  ; }
+	virtual inline bool			omnidirectional() const		{ return _omni		; }
+	// Distance beyond which the light is culled from clusters; derived from the intensity when not set
+	virtual inline float		range		() const		{ return _range>0?_range:sqrtf(std::max(_intensity.r,std::max(_intensity.g,_intensity.b))/rangeCutoff); }
 
 	virtual inline void			shadowing	(bool v) 		{ _shadowing=v; }
 	virtual inline void			pos			(const vec3& v) { _pos		=v; }
 	virtual inline void			intensity	(const vec3& v) { _intensity=v; }
 	virtual inline void			radius		(float v)		{ _radius		=v; }
 	virtual inline void			enabled		(bool v)		{ _enabled		=v; }
+	virtual inline void			omnidirectional(bool v)		{ _omni			=v; }
+	virtual inline void			range		(float v)		{ _range		=v; }
+	virtual inline int			shadowMapSize() const		{ return _shadowMapSize; }
+	virtual inline void			shadowMapSize(int v)		{ if( v!=_shadowMapSize ) { _shadowMapSize=v; invalidateShadowMap(); } }
 
 	virtual inline mat4			getShadowV(const vec3& c)	{ return lookAt(_pos, c, vec3(0,1,0)); }
 	virtual inline mat4			getShadowP()				{ return perspective(shadowFov, 1.f, shadowZNear, shadowZFar); }
+	// View-projections of the six cube faces, in GL_TEXTURE_CUBE_MAP_POSITIVE_X.. order
+	virtual inline void			getShadowCubeVP(mat4 vp[6]) {
+		const vec3 dirs[6] = {{1,0,0},{-1,0,0},{0,1,0},{0,-1,0},{0,0,1},{0,0,-1}};
+		const vec3 ups[6]  = {{0,-1,0},{0,-1,0},{0,0,1},{0,0,-1},{0,-1,0},{0,-1,0}};
+		mat4 P = perspective(3.1415926f/2, 1.f, shadowCubeZNear, shadowZFar);
+		for( int f=0; f<6; f++ )
+			vp[f] = P*lookAt(_pos, _pos+dirs[f], ups[f]);
+	}
 	
 	virtual inline void			setUniforms(GLuint prog, int i, const vec3& c) {
 		mat4 shadowV = getShadowV(c), shadowP = getShadowP();
@@ -46,13 +64,25 @@ struct PointLight {
 		setUniform(prog,lprefix+"intensity",	_intensity );
 		setUniform(prog,lprefix+"pos",			_pos );
 		setUniform(prog,lprefix+"dir",			normalize( c-_pos ) );
-		setUniform(prog,lprefix+"cosFov",		cosf(shadowFov/2) );
+		setUniform(prog,lprefix+"cosFov",		_omni?-2.f:cosf(shadowFov/2) );
 		
 		std::string sprefix = std::string("shadowers[")+std::to_string(i)+"].";
+		// Both samplers need their own units even when unused
+		setUniform(prog,sprefix+"map",		8+i);
+		setUniform(prog,sprefix+"cubeMap",	10+i);
 		if( !_shadowing ) {
 			setUniform(prog,sprefix+"shadowEnabled", 0);
 		}
+		else if( _omni ) {
+			_shadowCube.bindDepth(prog, sprefix+"cubeMap", 10+i);
+			setUniform(prog,sprefix+"radius", 	_radius);
+			setUniform(prog,sprefix+"enabled", 1);
+			setUniform(prog,sprefix+"cube", 1);
+			setUniform(prog,sprefix+"pos", _pos);
+			setUniform(prog,sprefix+"zFar", shadowZFar );
+		}
 		else {
+			setUniform(prog,sprefix+"cube", 0);
 			_shadowMap.bindDepth(prog, sprefix+"map", 8+i);
 			setUniform(prog,sprefix+"radius", 	_radius);
 			setUniform(prog,sprefix+"enabled", 1);
@@ -65,26 +95,113 @@ struct PointLight {
 					   *shadowP*shadowV);
 		}
 	}
-	virtual inline void			prepareShadowMap(GLuint prog, const vec3& c, std::function<void()> renderFunc) {
-		if( !_shadowing ) return;
-		_shadowMap.create(2048,2048);
+	// Re-renders the shadow map regardless of the cached state
+	virtual inline void			prepareShadowMap(GLuint prog, const vec3& c, const JGL2::Delegate<void()>& renderFunc) {
+		invalidateShadowMap();
+		prepareShadowMap(prog, c, nullptr, 0, renderFunc, 0);
+	}
+	// Renders the shadow map only when the light, its target or the casters changed.
+	// Static casters are kept in a separate map, which is copied under the dynamic casters.
+	virtual inline bool			prepareShadowMap(GLuint prog, const vec3& c,
+												 const JGL2::Delegate<void()>& staticFunc, size_t staticVersion,
+												 const JGL2::Delegate<void()>& dynamicFunc, size_t sceneVersion) {
+		if( !_shadowing ) return false;
+		bool lightMoved = !_shadowMapValid || _shadowCachedOmni || _shadowCachedPos != _pos || _shadowCachedCenter != c;
+		bool staticOutdated = staticFunc && ( lightMoved || !_staticShadowMapValid || _staticCachedVersion != staticVersion );
+		if( !lightMoved && !staticOutdated && _shadowCachedVersion == sceneVersion ) return false;
+
+		mat4 shadowV = getShadowV(c), shadowP = getShadowP();
+		setUniform(prog,"modelMat", mat4(1));
+		setUniform(prog,"projMat", shadowP);
+		setUniform(prog,"viewMat", shadowV);
+		if( staticOutdated ) {
+			_staticShadowMap.create(_shadowMapSize,_shadowMapSize);
+			_staticShadowMap.setToTarget();
+			glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+			staticFunc();
+			_staticShadowMap.restoreVP();
+			_staticCachedVersion = staticVersion;
+			_staticShadowMapValid = true;
+		}
+		_shadowMap.create(_shadowMapSize,_shadowMapSize);
 		_shadowMap.setToTarget();
-		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		if( staticFunc ) {
+			_shadowMap.copyDepthFrom(_staticShadowMap);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+		else
+			glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 		//		glEnable(GL_CULL_FACE);
 		//		glCullFace(GL_FRONT);
 		setUniform(prog,"modelMat", mat4(1));
-		setUniform(prog,"projMat", getShadowP());
-		setUniform(prog,"viewMat", getShadowV(c));
-		renderFunc();
+		dynamicFunc();
 		_shadowMap.restoreVP();
 		glDisable(GL_CULL_FACE);
+		
+		_shadowCachedPos = _pos;
+		_shadowCachedCenter = c;
+		_shadowCachedVersion = sceneVersion;
+		_shadowCachedOmni = false;
+		_shadowMapValid = true;
+		return true;
 	}
+	// Renders all six faces of the cube shadow map in one pass; prog should be the
+	// layered program, whose geometry shader routes each triangle to every face.
+	// Layered targets cannot be blitted, so static casters are re-rendered along
+	// with the dynamic ones when anything changes.
+	virtual inline bool			prepareShadowCube(GLuint prog,
+												  const JGL2::Delegate<void()>& staticFunc, size_t staticVersion,
+												  const JGL2::Delegate<void()>& dynamicFunc, size_t sceneVersion) {
+		if( !_shadowing ) return false;
+		bool lightMoved = !_shadowMapValid || !_shadowCachedOmni || _shadowCachedPos != _pos;
+		bool staticOutdated = staticFunc && _staticCachedVersion != staticVersion;
+		if( !lightMoved && !staticOutdated && _shadowCachedVersion == sceneVersion ) return false;
+
+		mat4 cubeVP[6];
+		getShadowCubeVP(cubeVP);
+		setUniform(prog,"cubeVP", cubeVP, 6);
+		setUniform(prog,"lightPos", _pos);
+		setUniform(prog,"zFar", shadowZFar);
+		setUniform(prog,"modelMat", mat4(1));
+		_shadowCube.create(_shadowCubeSize);
+		_shadowCube.setToTarget();
+		glClear(GL_DEPTH_BUFFER_BIT);
+		if( staticFunc ) staticFunc();
+		setUniform(prog,"modelMat", mat4(1));
+		dynamicFunc();
+		_shadowCube.restoreVP();
+
+		_shadowCachedPos = _pos;
+		_shadowCachedVersion = sceneVersion;
+		_staticCachedVersion = staticVersion;
+		_shadowCachedOmni = true;
+		_shadowMapValid = true;
+		_staticShadowMapValid = false;
+		return true;
+	}
+	virtual inline void			invalidateShadowMap() { _shadowMapValid = _staticShadowMapValid = false; }
+	virtual inline bool			shadowMapValid() const { return _shadowMapValid; }
+
 	bool	_enabled	= true;
 	bool	_shadowing	= true;
 	vec3	_pos		= {100,200,150};
 	vec3	_intensity	= vec3(250000);
 	float	_radius		= 1;
+	float	_range		= 0;
+	bool	_omni		= false;
+	int		_shadowMapSize	= 2048;
+	int		_shadowCubeSize	= 1024;
 	FramebufferObj	_shadowMap;
+	FramebufferObj	_staticShadowMap;
+	CubeDepthFramebufferObj	_shadowCube;
+
+	bool	_shadowMapValid			= false;
+	bool	_staticShadowMapValid	= false;
+	bool	_shadowCachedOmni		= false;
+	vec3	_shadowCachedPos;
+	vec3	_shadowCachedCenter;
+	size_t	_shadowCachedVersion	= 0;
+	size_t	_staticCachedVersion	= 0;
 };
 
 
@@ -0,0 +1,131 @@
+//
+//  JR_LightClusters.hpp
+//  JGL2
+//
+
+#ifndef JR_LightClusters_h
+#define JR_LightClusters_h
+
+#include <vector>
+#include <algorithm>
+
+namespace JR {
+
+// Bins point lights into a view frustum grid (dimX x dimY screen tiles x dimZ
+// exponential depth slices) on the CPU. The result is uploaded as one RGBA32F
+// buffer texture: the light data (3 texels per light), one (offset,count) texel
+// per cluster, then the light index list packed four to a texel.
+// Indices are stored as floats, which are exact far beyond any practical count.
+struct LightClusters {
+	int dimX = 16, dimY = 9, dimZ = 24;
+
+	virtual inline void			build( const std::vector<const PointLight*>& lights, const Camera& camera, const vec3& c );
+	virtual inline void			bind( GLuint prog, GLuint slot, const GLint vp[4] );
+	virtual inline void			clearGL();
+	virtual inline size_t		lights() const { return _nLights; }
+
+protected:
+	virtual inline int			slice( float z ) const;
+	static  inline void			upload( GLuint& buf, GLuint& tex, GLenum format, const void* data, size_t bytes );
+
+	std::vector<std::vector<GLuint>>	_bins;
+	std::vector<vec4>	_data;
+	std::vector<float>	_indices;
+	GLuint	_dataBuf = 0, _dataTex = 0;
+	int		_headerOffset = 0, _indexOffset = 0;
+	float	_near = 10.f, _far = 10000.f;
+	size_t	_nLights = 0;
+};
+
+inline int LightClusters::slice( float z ) const {
+	int k = int( logf( z/_near )/logf( _far/_near )*dimZ );
+	return std::min( std::max( k, 0 ), dimZ-1 );
+}
+
+inline void LightClusters::build( const std::vector<const PointLight*>& lights, const Camera& camera, const vec3& c ) {
+	const mat4& V = camera.viewMat();
+	const mat4& P = camera.projMat();
+	// Recover the clipping planes from the perspective matrix
+	_near = P[3][2]/(P[2][2]-1);
+	_far  = P[3][2]/(P[2][2]+1);
+	_nLights = lights.size();
+
+	size_t nClusters = size_t(dimX*dimY*dimZ);
+	_bins.resize( nClusters );
+	for( auto& b: _bins ) b.clear();
+	_data.clear();
+
+	for( size_t li=0; li<lights.size(); li++ ) {
+		const PointLight& l = *lights[li];
+		float r = l.range();
+		_data.push_back( vec4( l.pos(), r ) );
+		_data.push_back( vec4( l.intensity(), l.omnidirectional()?-2.f:cosf(l.shadowFov/2) ) );
+		_data.push_back( vec4( normalize( c-l.pos() ), 0 ) );
+
+		vec4 cv = V*vec4( l.pos(), 1 );
+		float d = -cv.z;
+		if( d+r<_near || d-r>_far ) continue;
+		float zs[2] = { std::max( d-r, _near ), std::min( d+r, _far ) };
+		float xs[2] = { cv.x-r, cv.x+r };
+		float ys[2] = { cv.y-r, cv.y+r };
+		// x/z is monotonic in both, so the corners bound the projected sphere
+		float minX = 1, maxX = -1, minY = 1, maxY = -1;
+		for( int a=0; a<2; a++ ) for( int b=0; b<2; b++ ) {
+			float x = P[0][0]*xs[a]/zs[b], y = P[1][1]*ys[a]/zs[b];
+			minX = std::min( minX, x ); maxX = std::max( maxX, x );
+			minY = std::min( minY, y ); maxY = std::max( maxY, y );
+		}
+		if( minX>1 || maxX<-1 || minY>1 || maxY<-1 ) continue;
+		int i0 = std::max( 0, int( floorf( (minX+1)/2*dimX ) ) ), i1 = std::min( dimX-1, int( floorf( (maxX+1)/2*dimX ) ) );
+		int j0 = std::max( 0, int( floorf( (minY+1)/2*dimY ) ) ), j1 = std::min( dimY-1, int( floorf( (maxY+1)/2*dimY ) ) );
+		int k0 = slice( zs[0] ), k1 = slice( zs[1] );
+		for( int k=k0; k<=k1; k++ ) for( int j=j0; j<=j1; j++ ) for( int i=i0; i<=i1; i++ )
+			_bins[(k*dimY+j)*dimX+i].push_back( GLuint(li) );
+	}
+
+	_headerOffset = int( _data.size() );
+	_indexOffset = _headerOffset+int( nClusters );
+	_indices.clear();
+	for( size_t i=0; i<nClusters; i++ ) {
+		_data.push_back( vec4( float( _indices.size() ), float( _bins[i].size() ), 0, 0 ) );
+		_indices.insert( _indices.end(), _bins[i].begin(), _bins[i].end() );
+	}
+	_indices.resize( (_indices.size()+3)/4*4, 0.f );
+	for( size_t i=0; i<_indices.size(); i+=4 )
+		_data.push_back( vec4( _indices[i], _indices[i+1], _indices[i+2], _indices[i+3] ) );
+	upload( _dataBuf, _dataTex, GL_RGBA32F, _data.data(), sizeof(vec4)*_data.size() );
+}
+
+inline void LightClusters::upload( GLuint& buf, GLuint& tex, GLenum format, const void* data, size_t bytes ) {
+	if( !buf ) glGenBuffers( 1, &buf );
+	glBindBuffer( GL_TEXTURE_BUFFER, buf );
+	glBufferData( GL_TEXTURE_BUFFER, std::max( bytes, size_t(16) ), nullptr, GL_STREAM_DRAW );
+	if( bytes>0 ) glBufferSubData( GL_TEXTURE_BUFFER, 0, bytes, data );
+	glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+	if( !tex ) {
+		glGenTextures( 1, &tex );
+		glBindTexture( GL_TEXTURE_BUFFER, tex );
+		glTexBuffer( GL_TEXTURE_BUFFER, format, buf );
+		glBindTexture( GL_TEXTURE_BUFFER, 0 );
+	}
+}
+
+inline void LightClusters::bind( GLuint prog, GLuint slot, const GLint vp[4] ) {
+	glActiveTexture( GL_TEXTURE0+slot );
+	glBindTexture( GL_TEXTURE_BUFFER, _dataTex );
+	setUniform( prog, "clusterData", int(slot) );
+	setUniform( prog, "clusterEnabled", _nLights>0?1:0 );
+	setUniform( prog, "clusterOffsets", ivec2( _headerOffset, _indexOffset ) );
+	setUniform( prog, "clusterDims", ivec3( dimX, dimY, dimZ ) );
+	setUniform( prog, "clusterDepth", vec2( _near, logf( _far/_near ) ) );
+	setUniform( prog, "clusterViewport", vec4( float(vp[0]), float(vp[1]), float(vp[2]), float(vp[3]) ) );
+}
+
+inline void LightClusters::clearGL() {
+	if( _dataTex ) { glDeleteTextures( 1, &_dataTex );	_dataTex = 0; }
+	if( _dataBuf ) { glDeleteBuffers( 1, &_dataBuf );	_dataBuf = 0; }
+}
+
+} // namespace JR
+
+#endif /* JR_LightClusters_h */
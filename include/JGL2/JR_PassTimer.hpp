@@ -0,0 +1,144 @@
+//
+//  JR_PassTimer.hpp
+//  JGL2
+//
+
+#ifndef JR_PassTimer_h
+#define JR_PassTimer_h
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+namespace JR {
+
+struct PassTime {
+	const char*	name;
+	float		ms;			// Smoothed GPU time per frame
+	int			depth;		// Nesting level
+};
+
+// GPU time per named pass. Every begin()/end() pair is bracketed by two timestamp
+// queries (so passes may nest, unlike GL_TIME_ELAPSED) kept in a ring and read back
+// when available, a few frames later, without stalling. Passes with the same name
+// in one frame (e.g. several views sharing a renderer) are added up.
+// Names must outlive the timer; string literals are expected.
+struct PassTimer {
+	bool	enabled = true;
+
+	// newFrame false continues the current frame
+	virtual inline void							beginFrame(bool newFrame=true);
+	virtual inline void							begin(const char* name);
+	virtual inline void							end();
+	// Collects finished queries; call once per view
+	virtual inline void							endFrame();
+	// Passes of the last completed frame, in the order they were begun
+	virtual inline const std::vector<PassTime>&	times() const { return _times; }
+	virtual inline float						time(const char* name) const;
+	// Queries issued but not yet read back
+	virtual inline bool							pending() const { return _pending>0; }
+	virtual inline void							clearGL();
+
+	struct Scope {
+		Scope(PassTimer& t, const char* name): _t(t) { _t.begin(name); }
+		~Scope() { _t.end(); }
+		PassTimer& _t;
+	};
+
+protected:
+	static constexpr int RING = 128;
+	struct Zone {
+		const char*	name;
+		size_t		tag;
+		int			depth;
+		bool		open;
+	};
+	GLuint				_queries[RING][2] = {};
+	Zone				_zones[RING] = {};
+	std::vector<int>	_stack;
+	size_t				_frameTag = 0, _accTag = 0;
+	int					_head = 0, _pending = 0;
+	int					_dropped = 0;
+	std::vector<PassTime>	_acc, _times;
+
+	virtual inline void	publish();
+};
+
+inline void PassTimer::beginFrame(bool newFrame) {
+	if( newFrame ) _frameTag++;
+	_stack.clear();
+	_dropped = 0;
+}
+
+inline void PassTimer::begin(const char* name) {
+	if( !enabled || _pending>=RING ) { _dropped++; return; }
+	if( !_queries[0][0] ) glGenQueries( RING*2, &_queries[0][0] );
+	_zones[_head] = { name, _frameTag, int(_stack.size()), true };
+	glQueryCounter( _queries[_head][0], GL_TIMESTAMP );
+	_stack.push_back(_head);
+	_head = (_head+1)%RING;
+	_pending++;
+}
+
+inline void PassTimer::end() {
+	if( _dropped>0 ) { _dropped--; return; }
+	if( _stack.empty() ) return;
+	int z = _stack.back();
+	_stack.pop_back();
+	glQueryCounter( _queries[z][1], GL_TIMESTAMP );
+	_zones[z].open = false;
+}
+
+inline void PassTimer::endFrame() {
+	while( _pending>0 ) {
+		int oldest = (_head-_pending+RING)%RING;
+		const Zone& z = _zones[oldest];
+		if( z.open ) break;
+		GLint available = 0;
+		glGetQueryObjectiv( _queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( !available ) break;
+		GLuint64 t0, t1;
+		glGetQueryObjectui64v( _queries[oldest][0], GL_QUERY_RESULT, &t0 );
+		glGetQueryObjectui64v( _queries[oldest][1], GL_QUERY_RESULT, &t1 );
+		_pending--;
+		if( z.tag!=_accTag ) {
+			publish();
+			_accTag = z.tag;
+		}
+		float ms = float( t1-t0 )*1e-6f;
+		auto it = std::find_if( _acc.begin(), _acc.end(), [&](const PassTime& p){ return strcmp(p.name,z.name)==0; } );
+		if( it==_acc.end() ) _acc.push_back( { z.name, ms, z.depth } );
+		else it->ms += ms;
+	}
+	// Publish as soon as the rest in flight belongs to later frames, so that results
+	// show up one redraw after they are ready, not two
+	if( _pending>0 && _zones[(_head-_pending+RING)%RING].tag!=_accTag ) publish();
+}
+
+inline void PassTimer::publish() {
+	if( _acc.empty() ) return;
+	for( auto& p: _acc ) {
+		auto it = std::find_if( _times.begin(), _times.end(), [&](const PassTime& q){ return strcmp(p.name,q.name)==0; } );
+		if( it!=_times.end() ) p.ms = it->ms*.9f+p.ms*.1f;
+	}
+	_times.swap(_acc);
+	_acc.clear();
+}
+
+inline float PassTimer::time(const char* name) const {
+	for( auto& p: _times ) if( strcmp(p.name,name)==0 ) return p.ms;
+	return 0;
+}
+
+inline void PassTimer::clearGL() {
+	if( _queries[0][0] ) glDeleteQueries( RING*2, &_queries[0][0] );
+	for( auto& q: _queries ) q[0] = q[1] = 0;
+	_pending = 0;
+	_stack.clear();
+	_acc.clear();
+	_accTag = 0;
+}
+
+} // namespace JR
+
+#endif /* JR_PassTimer_h */
@@ -15,8 +15,8 @@ using JRender::vec3;
 using JRender::vec4;
 using JRender::mat4;
 
-typedef std::function<bool(const vec3&)> Motion3DCallback_t;
-typedef std::function<bool(button_t)> Button3DCallback_t;
+typedef Delegate<bool(const vec3&)> Motion3DCallback_t;
+typedef Delegate<bool(button_t)> Button3DCallback_t;
 
 struct Picker3D {
 	virtual inline vec3		eventPt3D() { return _cursorPt3; }
@@ -0,0 +1,160 @@
+//
+//  JR_QualityGovernor.hpp
+//  JGL2
+//
+
+#ifndef JR_QualityGovernor_h
+#define JR_QualityGovernor_h
+
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace JR {
+
+struct QualityLevel {
+	int		shadowMapSize;
+	int		shadowSamples;		// PCSS filter taps (cube shadows use half)
+	int		blockerSamples;		// PCSS blocker search taps
+	float	renderScale;		// Internal resolution of the HDR target
+};
+
+// Holds a target frame rate by stepping through levelTable (0 is the best quality).
+// Off by default. Two times are tracked:
+//  - the frame period, wall time between consecutive frames of the renderer, which
+//    covers everything else the application does (UI, other windows, swaps); gaps
+//    longer than idleMs are the application waiting for input and are skipped
+//  - the renderer's GPU time, from timestamp queries read back a few frames late so
+//    that nothing stalls; views sharing a renderer add up to one frame
+// The levels only change GPU work, so the GPU time decides both ways: a level is
+// dropped after degradeFrames consecutive frames over budget, and raised only after
+// improveFrames frames well under it. A slow period counts against the budget only
+// when the GPU time is over the plain budget too, so that a CPU-bound application is
+// not degraded for nothing (and raised back, over and over). Every change is
+// followed by settleFrames frames that are not judged.
+struct QualityGovernor {
+	bool	enabled			= false;
+	float	targetFPS		= 60.f;
+	float	degradeRatio	= 1.2f;		// of the frame budget; leaves room for vsync jitter
+	float	improveRatio	= .6f;
+	float	idleMs			= 250.f;
+	int		degradeFrames	= 10;
+	int		improveFrames	= 90;
+	int		settleFrames	= 30;
+
+	std::vector<QualityLevel> levelTable = {
+		{ 2048, 64, 32, 1.f  },
+		{ 2048, 32, 16, 1.f  },
+		{ 1024, 32, 16, .85f },
+		{ 1024, 16,  8, .75f },
+		{  512, 16,  8, .6f  },
+		{  512,  8,  4, .5f  },
+	};
+
+	// newFrame false adds the following span to the current frame
+	virtual inline void					beginFrame(bool newFrame=true);
+	// Returns true when the level changed
+	virtual inline bool					endFrame();
+	virtual inline int					level() const { return _level; }
+	virtual inline void					level(int l) { _level = std::min( std::max( l, 0 ), int(levelTable.size())-1 ); reset(); }
+	virtual inline const QualityLevel&	quality() const { return levelTable[_level]; }
+	// Smoothed GPU time per frame in milliseconds
+	virtual inline float				gpuTime() const { return _avgTime; }
+	// Smoothed wall time between frames in milliseconds
+	virtual inline float				framePeriod() const { return _avgPeriod; }
+	virtual inline void					clearGL();
+
+protected:
+	static constexpr int RING = 16;
+	virtual inline bool					judge( float ms );
+	virtual inline void					reset() { _over = _under = 0; _settle = settleFrames; _nSamples = _nPeriods = 0; }
+
+	GLuint	_queries[RING][2] = {};
+	size_t	_tags[RING] = {};
+	size_t	_frameTag = 0, _accTag = 0;
+	float	_accTime = 0;
+	int		_head = 0, _pending = 0;
+	bool	_measuring = false;
+	int		_level = 0;
+	int		_over = 0, _under = 0, _settle = 0, _nSamples = 0;
+	float	_avgTime = 0;
+	float	_avgPeriod = 0;
+	int		_nPeriods = 0;
+	std::chrono::steady_clock::time_point	_frameStart;
+};
+
+inline void QualityGovernor::beginFrame(bool newFrame) {
+	if( newFrame && enabled ) {
+		auto now = std::chrono::steady_clock::now();
+		float ms = std::chrono::duration<float,std::milli>( now-_frameStart ).count();
+		if( _frameTag>0 && ms<idleMs )
+			_avgPeriod = _nPeriods++>0 ? _avgPeriod*.9f+ms*.1f : ms;
+		_frameStart = now;
+	}
+	if( newFrame ) _frameTag++;
+	_measuring = enabled && _pending<RING;
+	if( !_measuring ) return;
+	_tags[_head] = _frameTag;
+	if( !_queries[0][0] ) glGenQueries( RING*2, &_queries[0][0] );
+	glQueryCounter( _queries[_head][0], GL_TIMESTAMP );
+}
+
+inline bool QualityGovernor::endFrame() {
+	if( !_measuring ) return false;
+	glQueryCounter( _queries[_head][1], GL_TIMESTAMP );
+	_head = (_head+1)%RING;
+	_pending++;
+	bool changed = false;
+	while( _pending>0 ) {
+		int oldest = (_head-_pending+RING)%RING;
+		GLint available = 0;
+		glGetQueryObjectiv( _queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available );
+		if( !available ) break;
+		GLuint64 t0, t1;
+		glGetQueryObjectui64v( _queries[oldest][0], GL_QUERY_RESULT, &t0 );
+		glGetQueryObjectui64v( _queries[oldest][1], GL_QUERY_RESULT, &t1 );
+		_pending--;
+		// A frame is judged once a span of a later frame comes back
+		if( _tags[oldest]!=_accTag ) {
+			if( _accTag>0 ) changed |= judge( _accTime );
+			_accTag = _tags[oldest];
+			_accTime = 0;
+		}
+		_accTime += float( t1-t0 )*1e-6f;
+	}
+	return changed;
+}
+
+inline bool QualityGovernor::judge( float ms ) {
+	_avgTime = _nSamples++>0 ? _avgTime*.9f+ms*.1f : ms;
+	if( _settle>0 ) { _settle--; return false; }
+	float budget = 1000.f/targetFPS;
+	bool slowPeriod = _nPeriods>0 && _avgPeriod>budget*degradeRatio;
+	bool over = _avgTime>budget*degradeRatio || ( slowPeriod && _avgTime>budget );
+	if( over )									{ _over++;	_under = 0; }
+	else if( _avgTime<budget*improveRatio )		{ _under++;	_over = 0; }
+	else										_over = _under = 0;
+	if( _over>=degradeFrames && _level<int(levelTable.size())-1 ) {
+		_level++;
+		reset();
+		return true;
+	}
+	if( _under>=improveFrames && _level>0 ) {
+		_level--;
+		reset();
+		return true;
+	}
+	return false;
+}
+
+inline void QualityGovernor::clearGL() {
+	if( _queries[0][0] ) glDeleteQueries( RING*2, &_queries[0][0] );
+	for( auto& q: _queries ) q[0] = q[1] = 0;
+	_pending = 0;
+	_measuring = false;
+	_accTag = 0;
+}
+
+} // namespace JR
+
+#endif /* JR_QualityGovernor_h */
@@ -8,37 +8,109 @@
 #ifndef _JR_Renderer_h
 #define _JR_Renderer_h
 
+#include "_Delegate.hpp"
 #include "JR_FramebufferObj.hpp"
 #include "JR_Light.hpp"
+#include "JR_LightClusters.hpp"
+#include "JR_IBL.hpp"
+#include "JR_QualityGovernor.hpp"
+#include "JR_PassTimer.hpp"
+#include "_Profiler.hpp"
+#include "_TaskPool.hpp"
+#include <atomic>
 #include <functional>
+#include <map>
 
 namespace JR {
 
-typedef std::function<void()> RenderFunc;
+typedef JGL2::Delegate<void()> RenderFunc;
 
 struct Renderer {
 	virtual void render(const sz2_t& sz,Camera& c)=0;
 	virtual ~Renderer(){}
 	
-	virtual inline void	renderFunc(RenderFunc f) { _renderFunc = f; }
-	virtual inline void resetRenderFunc() { _renderFunc = defRenderFunc; }
+	virtual inline void	renderFunc(RenderFunc f) { _renderFunc = f; sceneChanged(); }
+	virtual inline void resetRenderFunc() { _renderFunc = defRenderFunc; sceneChanged(); }
+	
+	// Geometry that never moves (ground, set pieces); its shadow is cached separately
+	virtual inline void	staticFunc(RenderFunc f) { _staticFunc = f; _hasStaticFunc = true; staticSceneChanged(); }
+	virtual inline void resetStaticFunc() { _staticFunc = defRenderFunc; _hasStaticFunc = false; staticSceneChanged(); }
 	
 	virtual inline void	wireFunc(RenderFunc f) { _wireFunc = f; }
 	virtual inline void resetWireFunc() { _wireFunc = defRenderFunc; }
+	
+	// Scene update (e.g. forward kinematics), run once per scene version before any pass,
+	// so that renderFunc only draws and views sharing the renderer do not repeat it
+	virtual inline void	updateFunc(RenderFunc f) { _updateFunc = f; sceneChanged(); }
+	virtual inline void resetUpdateFunc() { _updateFunc = defRenderFunc; }
+	
+	// A renderer may be shared by several views; call when a camera stops using it
+	virtual inline void	releaseView(const Camera* c);
+	// GPU time per pass, nullptr when the renderer is not instrumented
+	virtual inline PassTimer*	passTimer() { return nullptr; }
+	// True while background work (e.g. loading) will change a later frame; safe from any thread
+	virtual inline bool			pendingWork() const { return false; }
 	virtual inline void copyFrom(const Renderer& r);
 	virtual inline void copyFrom(const Renderer* r) { copyFrom(*r); }
 	
+	// Notify that the contents drawn by renderFunc/staticFunc are changed; any thread
+	virtual inline void		sceneChanged() { _sceneVersion++; }
+	virtual inline void		staticSceneChanged() { _staticSceneVersion++; }
+	virtual inline size_t	sceneVersion() const { return _sceneVersion; }
+	virtual inline size_t	staticSceneVersion() const { return _staticSceneVersion; }
+	
 	const RenderFunc defRenderFunc = [](){};
 	RenderFunc _renderFunc = defRenderFunc;
+	RenderFunc _staticFunc = defRenderFunc;
 	RenderFunc _wireFunc   = defRenderFunc;
+	RenderFunc _updateFunc = defRenderFunc;
+	bool	_hasStaticFunc = false;
+	// Bumped from the UI thread while the render thread reads them
+	std::atomic<size_t>	_sceneVersion = 1;
+	std::atomic<size_t>	_staticSceneVersion = 1;
+	size_t	_updatedVersion = 0;
+	std::vector<const Camera*>	_frameViews;
+	
+	virtual inline bool	beginView(const Camera& c);
+	virtual inline void	updateScene();
 };
+
+// True for the first view of a frame; a camera that was already drawn starts the next frame
+inline bool Renderer::beginView(const Camera& c) {
+	bool newFrame = _frameViews.empty() || std::find(_frameViews.begin(), _frameViews.end(), &c)!=_frameViews.end();
+	if( newFrame ) _frameViews.clear();
+	_frameViews.push_back(&c);
+	return newFrame;
+}
+
+inline void Renderer::releaseView(const Camera* c) {
+	_frameViews.erase(std::remove(_frameViews.begin(), _frameViews.end(), c), _frameViews.end());
+}
+
+inline void Renderer::updateScene() {
+	// A change made while updating is left for the next frame
+	size_t version = _sceneVersion;
+	if( _updatedVersion == version ) return;
+	JGL2_PROFILE_ZONE("Renderer::updateScene");
+	_updateFunc();
+	_updatedVersion = version;
+}
+
 inline void Renderer::copyFrom(const Renderer& r) {
 	_renderFunc = r._renderFunc;
+	_staticFunc = r._staticFunc;
 	_wireFunc = r._wireFunc;
+	_updateFunc = r._updateFunc;
+	_hasStaticFunc = r._hasStaticFunc;
+	sceneChanged();
+	staticSceneChanged();
 }
 
 struct NullRenderer: Renderer {
 	virtual inline void render(const sz2_t& sz,Camera& c) override {
+		JGL2_PROFILE_ZONE("NullRenderer::render");
+		updateScene();
+		_staticFunc();
 		_renderFunc();
 	}
 };
@@ -49,6 +121,12 @@ extern const std::string __const_frag_code__;
 extern const std::string __const_vert_code__;
 extern const std::string __shader_frag_code__;
 extern const std::string __shader_vert_code__;
+extern const std::string __cube_shadow_vert_code__;
+extern const std::string __fullscreen_vert_code__;
+extern const std::string __post_tonemap_frag_code__;
+extern const std::string __post_fxaa_frag_code__;
+extern const std::string __cube_shadow_geom_code__;
+extern const std::string __cube_shadow_frag_code__;
 
 extern const std::string __shader_frag_header__;
 extern const std::string __shader_frag_main__;
@@ -62,52 +140,400 @@ extern const std::string __shader_frag_material__;
 extern const std::string __shader_frag_lighting_point_Lambertian__;
 extern const std::string __shader_frag_lighting_point_Phong__;
 extern const std::string __shader_frag_lighting_point_PBR__;
+extern const std::string __shader_frag_lighting_clustered__;
+extern const std::string __shader_frag_lighting_clustered_null__;
 
 extern const std::string __shader_frag_shadow_null__;
 extern const std::string __shader_frag_shadow_PCF__;
 extern const std::string __shader_frag_shadow_PCSS__;
+extern const std::string __shader_frag_shadow_classify__;
 
 extern const std::string __shader_frag_ambOcc_null__;
+extern const std::string __shader_frag_ambOcc_SSAO__;
+extern const std::string __ssao_frag_code__;
 extern const std::string __shader_frag_ambient_const__;
+extern const std::string __shader_frag_ambient_SH__;
 extern const std::string __shader_frag_ambient_spherical__;
+extern const std::string __shader_frag_ambient_IBL__;
+
+
+
+// Draws a triangle covering the viewport; pair with __fullscreen_vert_code__
+inline void drawFullscreenTriangle() {
+	struct EmptyVA {
+		GLuint va = 0;
+		~EmptyVA() { if( va ) glDeleteVertexArrays( 1, &va ); }
+	};
+	static PerContext<EmptyVA> emptyVAs;
+	GLuint& emptyVA = emptyVAs.get().va;
+	if( !emptyVA ) glGenVertexArrays(1, &emptyVA);
+	glBindVertexArray(emptyVA);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+}
 
+// Screen sized targets, one set per camera drawing with the renderer
+struct ViewTargets {
+	FramebufferObj			hdr = FramebufferObj(GL_RGBA16F);
+	FramebufferObj			ldr = FramebufferObj(GL_RGBA8);
+	FramebufferObj			shadowClass;
+	FramebufferObj			ssaoDepth;
+	FramebufferObj			ssaoTarget = FramebufferObj(GL_RG16F);
+	GBufferObj				gbuffer;			// DeferredRenderer only
+	bool					shadowClassValid = false;
+	bool					ssaoValid = false;
+	
+	inline void clearGL() {
+		hdr.clearGL(); ldr.clearGL(); shadowClass.clearGL();
+		ssaoDepth.clearGL(); ssaoTarget.clearGL(); gbuffer.clearGL();
+	}
+};
 
-
+// Texture units: 0-7 material, 8-9 shadow maps, 10-11 shadow cubes,
+// 12 penumbra classes, 13 light clusters, 14 environment map, 15 SSAO
 struct PBRRenderer: Renderer {
+	// Shadowing lights are evaluated per fragment (MAX_N_LIGHTS in the shaders),
+	// all others go through the light clusters, without shadows
+	static constexpr size_t MAX_SHADOWED_LIGHTS = 2;
+	
 	PBRRenderer();
 	virtual 		void			render(const sz2_t& sz, Camera& c);
 	static	inline	Program&		getRenderProg();
 	static	inline	Program&		getConstProg();
+	static	inline	Program&		getCubeShadowProg();
+	static	inline	Program&		getShadowClassProg();
+	static	inline	Program&		getPostProg();
+	static	inline	Program&		getFXAAProg();
+	static	inline	Program&		getSSAOProg();
 	virtual inline	float			ambientFactor() const { return _ambientLight.factor(); }
 	virtual inline	void			ambientFactor(float v) { _ambientLight.factor(v); }
 	virtual inline	AmbLight&		ambientLight() { return _ambientLight; }
 	virtual inline	const AmbLight&	ambientLight() const { return _ambientLight; }
+	
+	// Light from an equirectangular PFM: SH9 irradiance replaces the ambient coefficients
+	// and a prefiltered map adds specular. Decoded on the worker pool, then uploaded by a
+	// later render(); the scene is drawn without it until then
+	virtual inline	void			environmentMap(const std::filesystem::path& fn) { _envMapFile = fn; _envMapPending = true; _envMapLoading = true; }
+	virtual inline	bool			pendingWork() const override { return _envMapLoading; }
+	virtual inline	EnvironmentMap&	environmentMap() { return _envMap; }
 	virtual inline	void			addPointLight(PointLight&& l);
 	virtual inline	void			addPointLight(const PointLight& l);
 	virtual inline	size_t			pointLights() const { return _pointLights.size(); }
+	static	inline	size_t			maxShadowedLights() { return MAX_SHADOWED_LIGHTS; }
 	virtual inline	PointLight&		pointLight(size_t i) { return _pointLights[i]; }
 	virtual inline	const PointLight&	pointLight(size_t i) const { return _pointLights[i]; }
+	
+	// Classify shadows at low resolution, so that the full PCSS kernel only runs in penumbrae
+	virtual inline	bool			penumbraClassification() const { return _penumbraClassification; }
+	virtual inline	void			penumbraClassification(bool v) { _penumbraClassification = v; }
+	
+	// Lay down depth with the const program first, then shade only the visible fragments
+	virtual inline	bool			depthPrepass() const { return _depthPrepass; }
+	virtual inline	void			depthPrepass(bool v) { _depthPrepass = v; }
+	
+	// Keep the shadow maps between frames, re-rendered only after sceneChanged(), a light
+	// change or a staticFunc change. Off by default, so scenes edited without calling
+	// sceneChanged() keep correct shadows; staticFunc casters are cached either way
+	virtual inline	bool			cacheShadows() const { return _cacheShadows; }
+	virtual inline	void			cacheShadows(bool v);
+	
+	// Shade into a linear RGBA16F target and tonemap once in a full-screen pass. Off by
+	// default: the target is single-sampled, so fxaa() replaces the window's MSAA
+	virtual inline	bool			hdr() const { return _hdr; }
+	virtual inline	void			hdr(bool v) { _hdr = v; }
+	virtual inline	bool			fxaa() const { return _fxaa; }
+	virtual inline	void			fxaa(bool v) { _fxaa = v; }
+	
+	// Half resolution screen-space ambient occlusion, read through computeAmbOcc(). Off by
+	// default; the forward path pays an extra depth-only scene submission for it
+	virtual inline	bool			ssao() const { return _ssao; }
+	virtual inline	void			ssao(bool v) { _ssao = v; }
+	virtual inline	float			ssaoRadius() const { return _ssaoRadius; }
+	virtual inline	void			ssaoRadius(float v) { _ssaoRadius = v; }
+	
+	// Internal resolution of the HDR target, upscaled by the post pass; ignored without hdr()
+	virtual inline	float			renderScale() const { return _renderScale; }
+	virtual inline	void			renderScale(float v) { _renderScale = std::min( std::max( v, .25f ), 1.f ); _userSet |= USER_RENDER_SCALE; }
+	virtual inline	int				shadowSamples() const { return _shadowSamples; }
+	virtual inline	void			shadowSamples(int v) { _shadowSamples = v; _userSet |= USER_SHADOW_SAMPLES; }
+	virtual inline	int				blockerSamples() const { return _blockerSamples; }
+	virtual inline	void			blockerSamples(int v) { _blockerSamples = v; _userSet |= USER_BLOCKER_SAMPLES; }
+	
+	// Drives shadow map size, sample counts and render scale from the measured frame
+	// time when enabled (off by default). Values set through the setters above, and
+	// lights whose shadow map size was changed by hand, are left alone
+	virtual inline	QualityGovernor&		qualityGovernor() { return _governor; }
+	virtual inline	const QualityGovernor&	qualityGovernor() const { return _governor; }
+	virtual inline	int				qualityLevel() const { return _governor.level(); }
+	virtual inline	PassTimer*		passTimer() override { return &_passTimer; }
+	virtual inline	void			releaseView(const Camera* c) override;
+	virtual inline	const vec3&		screenGamma() const { return _screenGamma; }
+	virtual inline	void			screenGamma(const vec3& v) { _screenGamma = v; }
 
 protected:
 	std::vector<PointLight>	_pointLights;
 	AmbLight				_ambientLight;
+	EnvironmentMap			_envMap;
+	std::filesystem::path	_envMapFile;
+	bool					_envMapPending = false;
+	std::atomic<bool>		_envMapLoading = false;
+	JGL2::Task<EnvironmentMap::Decoded>	_envMapTask;
 	vec3					_screenGamma = vec3(2.4);
 	mat3					_sRGB2Screen = mat3(1);
 	
+	bool					_penumbraClassification = true;
+	bool					_depthPrepass = false;
+	bool					_cacheShadows = false;
+	size_t					_uncachedShadowVersion = 0;
+	int						_shadowClassDownscale = 4;
+	
+	bool					_hdr = false;
+	bool					_fxaa = true;
+	float					_renderScale = 1.f;
+	int						_shadowSamples = 64;
+	int						_blockerSamples = 32;
+	QualityGovernor			_governor;
+	enum { USER_RENDER_SCALE=1, USER_SHADOW_SAMPLES=2, USER_BLOCKER_SAMPLES=4 };
+	int						_userSet = 0;
+	// Shadow map size last given to the lights by the governor
+	int						_appliedShadowMapSize = 2048;
+	PassTimer				_passTimer;
+	GLuint					_tonemapLUT = 0;
+	vec3					_tonemapLUTGamma = vec3(-1);
+	
+	bool					_ssao = false;
+	float					_ssaoRadius = 10.f;
+	
+	std::map<const Camera*,ViewTargets>	_views;
+	ViewTargets*			_view = nullptr;
+	vec3					_shadowCenter = vec3(0);
+	
+	std::vector<PointLight*>		_shadowedLights;
+	bool							_shadowLimitWarned = false;
+	std::vector<const PointLight*>	_clusteredLights;
+	LightClusters			_lightClusters;
+	
+	virtual inline	bool	prepareFrame(const Camera& c);
+	virtual inline	void	assignLights();
+	virtual inline	void	updateEnvironmentMap();
+	virtual inline	void	applyQuality();
+	virtual inline	ivec2	internalSize(const GLint vp[4]) const;
 	virtual inline	void	shadowPass(const Camera& c);
+	virtual inline	void	shadowClassPass(const Camera& c);
+	virtual inline	void	ssaoDepthPass(const Camera& c);
+	virtual inline	void	ssaoPass(const Camera& c, FramebufferObj& depthSrc);
+	virtual inline	void	depthPass(const Camera& c);
 	virtual inline	void	mainPass(const Camera& c);
+	virtual inline	void	setLightingUniforms(Program& prog, const Camera& c);
 	virtual inline	void	wirePass(const Camera& c);
+	virtual inline	void	beginHDR();
+	virtual inline	void	endHDR();
+	virtual inline	void	postPass();
+	virtual inline	void	updateTonemapLUT();
 };
 
 inline PBRRenderer::PBRRenderer(): Renderer() {
 	addPointLight({});
 }
 
-inline void PBRRenderer::shadowPass(const Camera& camera) {
+// Selects the camera's targets. Work that does not depend on the camera (scene update,
+// light assignment, shadow maps) runs only for the first view of a frame; shadows are
+// aimed at that view's scene center and reused by the others
+inline bool PBRRenderer::prepareFrame(const Camera& camera) {
+	JGL2_PROFILE_ZONE("PBRRenderer::prepareFrame");
+	_view = &_views[&camera];
+	bool newFrame = beginView(camera);
+	_governor.beginFrame(newFrame);
+	_passTimer.beginFrame(newFrame);
+	if( !newFrame ) return false;
+	updateScene();
+	applyQuality();
+	updateEnvironmentMap();
+	assignLights();
+	_shadowCenter = camera.sceneCenter();
+	_passTimer.begin("shadow");
+	shadowPass(camera);
+	_passTimer.end();
+	return true;
+}
+
+inline void PBRRenderer::releaseView(const Camera* c) {
+	Renderer::releaseView(c);
+	auto it = _views.find(c);
+	if( it == _views.end() ) return;
+	if( _view == &it->second ) _view = nullptr;
+	it->second.clearGL();
+	_views.erase(it);
+	// The clusters are shared by the views; free them with the last one
+	if( _views.empty() ) _lightClusters.clearGL();
+}
+
+inline void PBRRenderer::applyQuality() {
+	if( !_governor.enabled ) return;
+	const QualityLevel& q = _governor.quality();
+	for( auto& l: _pointLights )
+		if( l.shadowMapSize()==_appliedShadowMapSize ) l.shadowMapSize(q.shadowMapSize);
+	_appliedShadowMapSize = q.shadowMapSize;
+	if( !(_userSet&USER_SHADOW_SAMPLES) )	_shadowSamples = q.shadowSamples;
+	if( !(_userSet&USER_BLOCKER_SAMPLES) )	_blockerSamples = q.blockerSamples;
+	if( !(_userSet&USER_RENDER_SCALE) )		_renderScale = q.renderScale;
+}
+
+inline ivec2 PBRRenderer::internalSize(const GLint vp[4]) const {
+	float s = _hdr?_renderScale:1.f;
+	return ivec2( std::max(1,int(vp[2]*s)), std::max(1,int(vp[3]*s)) );
+}
+
+inline void PBRRenderer::updateEnvironmentMap() {
+	if( _envMapPending ) {
+		_envMapPending = false;
+		int size = _envMap.size, levels = _envMap.levels, samples = _envMap.samples;
+		_envMapTask = JGL2::_JGL::async( [fn=_envMapFile,size,levels,samples]() {
+			return EnvironmentMap::decode( fn, size, levels, samples );
+		} );
+	}
+	if( !_envMapTask.valid() || !_envMapTask.ready() ) return;
+	JGL2::Task<EnvironmentMap::Decoded> task = _envMapTask;
+	_envMapTask = {};
+	// A newer file may have been set meanwhile; this one is dropped then
+	if( !_envMapPending ) {
+		if( _envMap.upload( task.get() ) ) {
+			_ambientLight.coeff( _envMap.shCoeff() );
+			sceneChanged();
+		}
+		else
+			std::cerr<<"Failed to load environment map "<<_envMapFile<<std::endl;
+		_envMapLoading = false;
+	}
+}
+
+inline void PBRRenderer::cacheShadows(bool v) {
+	if( v == _cacheShadows ) return;
+	_cacheShadows = v;
+	for( auto& l: _pointLights ) l.invalidateShadowMap();
+}
+
+inline void PBRRenderer::shadowPass(const Camera&) {
+	static const RenderFunc noStaticFunc;
+	const RenderFunc& staticCasters = _hasStaticFunc?_staticFunc:noStaticFunc;
+	// Without caching, every frame is a new version for the dynamic casters
+	size_t sceneVersion = _cacheShadows ? size_t(_sceneVersion) : ++_uncachedShadowVersion;
+	for( auto l: _shadowedLights ) {
+		if( l->omnidirectional() ) {
+			Program& cube_Prog = getCubeShadowProg();
+			l->prepareShadowCube(cube_Prog.progId,
+								 staticCasters, _staticSceneVersion, _renderFunc, sceneVersion);
+		}
+		else {
+			Program& const_Prog = getConstProg();
+			l->prepareShadowMap(const_Prog.progId, _shadowCenter,
+								staticCasters, _staticSceneVersion, _renderFunc, sceneVersion);
+		}
+	}
+}
+
+inline void PBRRenderer::assignLights() {
+	_shadowedLights.clear();
+	_clusteredLights.clear();
+	for( auto& l: _pointLights ) if( l.enabled() ) {
+		if( l.shadowing() && _shadowedLights.size()<MAX_SHADOWED_LIGHTS )
+			_shadowedLights.push_back( &l );
+		else {
+			if( l.shadowing() && !_shadowLimitWarned ) {
+				std::cerr<<"PBRRenderer: only the first "<<MAX_SHADOWED_LIGHTS<<" shadowing lights cast shadows"<<std::endl;
+				_shadowLimitWarned = true;
+			}
+			_clusteredLights.push_back( &l );
+		}
+	}
+}
+
+// Renders the scene at 1/_shadowClassDownscale resolution and stores, for the first four lights,
+// 0 (lit), 1 (umbra) or 0.5 (penumbra) into the RGBA channels
+inline void PBRRenderer::shadowClassPass(const Camera& camera) {
+	_view->shadowClassValid = false;
+	if( !_penumbraClassification ) return;
+	bool needed = false;
+	for( auto l: _shadowedLights )
+		if( !l->omnidirectional() ) needed = true;
+	if( !needed ) return;
+	
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	int w = std::max(1,vp[2]/_shadowClassDownscale);
+	int h = std::max(1,vp[3]/_shadowClassDownscale);
+	GLfloat oldClear[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClear);
+	GLboolean oldBlend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+	
+	Program& classProg = getShadowClassProg();
+	camera.setUniforms(classProg.progId);
+	classProg.setUniform("modelMat", mat4(1));
+	classProg.setUniform("nLights", int(_shadowedLights.size()) );
+	for( size_t i=0; i<_shadowedLights.size(); i++)
+		_shadowedLights[i]->setUniforms( classProg.progId, int(i), _shadowCenter );
+	_view->shadowClass.create(w,h);
+	_view->shadowClass.setToTarget();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	_staticFunc();
+	_renderFunc();
+	_view->shadowClass.restoreVP();
+	
+	glClearColor(oldClear[0],oldClear[1],oldClear[2],oldClear[3]);
+	if( oldBlend ) glEnable(GL_BLEND);
+	_view->shadowClassValid = true;
+}
+
+// Half resolution depth for SSAO in the forward path
+inline void PBRRenderer::ssaoDepthPass(const Camera& camera) {
+	if( !_ssao ) return;
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
 	Program& const_Prog = getConstProg();
-	const_Prog.use();
-	for( int i=0; i<_pointLights.size(); i++)
-		_pointLights[i].prepareShadowMap(const_Prog.progId, camera.sceneCenter(),_renderFunc);
+	camera.setUniforms(const_Prog.progId);
+	const_Prog.setUniform("modelMat", mat4(1));
+	ivec2 sz = internalSize(vp);
+	_view->ssaoDepth.create(std::max(1,sz.x/2),std::max(1,sz.y/2));
+	_view->ssaoDepth.setToTarget();
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	_staticFunc();
+	_renderFunc();
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	_view->ssaoDepth.restoreVP();
+}
+
+// Stores (ambient visibility, linear depth) at half resolution; the depth lets the
+// main pass upsample bilaterally. Noise is interleaved gradient noise, fixed in
+// screen space so that a still image does not shimmer (nothing accumulates over frames).
+inline void PBRRenderer::ssaoPass(const Camera& camera, FramebufferObj& depthSrc) {
+	_view->ssaoValid = false;
+	if( !_ssao ) return;
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	GLboolean oldBlend = glIsEnabled(GL_BLEND);
+	GLboolean oldDepth = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	
+	ivec2 sz = internalSize(vp);
+	int w = std::max(1,sz.x/2), h = std::max(1,sz.y/2);
+	Program& ssaoProg = getSSAOProg();
+	depthSrc.bindDepth(ssaoProg.progId, "depthTex", 0);
+	ssaoProg.setUniform("projMat", camera.projMat());
+	ssaoProg.setUniform("invProj", inverse(camera.projMat()));
+	ssaoProg.setUniform("radius", _ssaoRadius);
+	ssaoProg.setUniform("aoSize", vec2(w,h));
+	_view->ssaoTarget.create(w,h);
+	_view->ssaoTarget.setToTarget();
+	drawFullscreenTriangle();
+	_view->ssaoTarget.restoreVP();
+	
+	if( oldBlend ) glEnable(GL_BLEND);
+	if( oldDepth ) glEnable(GL_DEPTH_TEST);
+	_view->ssaoValid = true;
 }
 
 inline void PBRRenderer::wirePass(const Camera& camera) {
@@ -122,28 +548,183 @@ inline void PBRRenderer::wirePass(const Camera& camera) {
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
+inline void PBRRenderer::depthPass(const Camera& camera) {
+	Program& const_Prog = getConstProg();
+	camera.setUniforms(const_Prog.progId);
+	const_Prog.setUniform("modelMat", mat4(1));
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	_staticFunc();
+	_renderFunc();
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
 inline void PBRRenderer::mainPass(const Camera& camera) {
+	if( _depthPrepass ) {
+		depthPass(camera);
+		glDepthMask(GL_FALSE);
+		glDepthFunc(GL_EQUAL);
+	}
 	Program& renderProg = getRenderProg();
 	renderProg.use();
 	camera.setUniforms(renderProg.progId);
 	renderProg.setUniform("color",		vec4(.8,.8,.8,1) );
 	renderProg.setUniform("modelMat",	mat4(1));
+	renderProg.setUniform("linearOutput", _hdr?1:0 );
+	setLightingUniforms(renderProg, camera);
+	_staticFunc();
+	_renderFunc();
+	if( _depthPrepass ) {
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LEQUAL);
+	}
+}
+
+inline void PBRRenderer::setLightingUniforms(Program& renderProg, const Camera& camera) {
 	renderProg.setUniform("sRGB2ScreenRGB", _sRGB2Screen );
 	renderProg.setUniform("screenGamma", _screenGamma);
 	_ambientLight.use( renderProg.progId );
 	
-	for( int i=0; i<_pointLights.size(); i++)
-		_pointLights[i].setUniforms( renderProg.progId, i, camera.sceneCenter() );
-	_renderFunc();
+	renderProg.setUniform("nLights", int(_shadowedLights.size()) );
+	renderProg.setUniform("nShadowSamples", _shadowSamples );
+	renderProg.setUniform("nBlockerSamples", _blockerSamples );
+	renderProg.setUniform("nCubeShadowSamples", std::max(1,_shadowSamples/2) );
+	for( size_t i=0; i<_shadowedLights.size(); i++)
+		_shadowedLights[i]->setUniforms( renderProg.progId, int(i), _shadowCenter );
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	_lightClusters.build( _clusteredLights, camera, _shadowCenter );
+	_lightClusters.bind( renderProg.progId, 13, vp );
+	_envMap.bind( renderProg.progId, 14 );
+	if( _view->shadowClassValid ) {
+		_view->shadowClass.bindColor( renderProg.progId, "shadowClass", 12 );
+		renderProg.setUniform("shadowClassEnabled", 1 );
+		renderProg.setUniform("shadowClassViewport", vec4(vp[0],vp[1],vp[2],vp[3]) );
+	}
+	else
+		renderProg.setUniform("shadowClassEnabled", 0 );
+	if( _view->ssaoValid ) {
+		_view->ssaoTarget.bindColor( renderProg.progId, "ssaoTex", 15 );
+		renderProg.setUniform("ssaoEnabled", 1 );
+		renderProg.setUniform("ssaoViewport", vec4(vp[0],vp[1],vp[2],vp[3]) );
+		renderProg.setUniform("ssaoView", camera.viewMat() );
+	}
+	else
+		renderProg.setUniform("ssaoEnabled", 0 );
 }
 
 inline void PBRRenderer::render(const sz2_t& sz, Camera& camera) {
+	JGL2_PROFILE_ZONE("PBRRenderer::render");
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 	camera.viewport(sz);
-	shadowPass(camera);
+	prepareFrame(camera);
+	_passTimer.begin("penumbra");
+	shadowClassPass(camera);
+	_passTimer.end();
+	_passTimer.begin("ssao");
+	ssaoDepthPass(camera);
+	ssaoPass(camera, _view->ssaoDepth);
+	_passTimer.end();
+	beginHDR();
+	_passTimer.begin("main");
 	mainPass(camera);
+	_passTimer.end();
+	_passTimer.begin("post");
+	endHDR();
+	_passTimer.end();
+	// After the post pass, which writes the scene depth: the const program outputs
+	// display-encoded color, which the tonemap would encode a second time
+	_passTimer.begin("wire");
 	wirePass(camera);
+	_passTimer.end();
+	_governor.endFrame();
+	_passTimer.endFrame();
+}
+
+inline void PBRRenderer::beginHDR() {
+	if( !_hdr ) return;
+	GLint vp[4];
+	GLfloat oldClear[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClear);
+	ivec2 sz = internalSize(vp);
+	_view->hdr.create(sz.x,sz.y);
+	_view->hdr.setToTarget();
+	glClearColor(0,0,0,0);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	glClearColor(oldClear[0],oldClear[1],oldClear[2],oldClear[3]);
+}
+
+inline void PBRRenderer::endHDR() {
+	if( !_hdr ) return;
+	_view->hdr.restoreVP();
+	postPass();
+}
+
+// 1D LUT of the screen transfer curve, indexed by sqrt(linear) for precision near black
+inline void PBRRenderer::updateTonemapLUT() {
+	if( _tonemapLUT && _tonemapLUTGamma == _screenGamma ) return;
+	const int N = 1024;
+	std::vector<vec3> lut(N);
+	auto curve = [](float u, float g) {
+		if( fabsf(g-2.4f)<0.01f ) return u>0.0031308f?(1.055f*powf(u,1/2.4f)-0.055f):(12.92f*u);
+		return powf(u,1/g);
+	};
+	for( int i=0; i<N; i++ ) {
+		float s = i/float(N-1), u = s*s;
+		lut[i] = vec3( curve(u,_screenGamma.r), curve(u,_screenGamma.g), curve(u,_screenGamma.b) );
+	}
+	if( !_tonemapLUT ) glGenTextures(1, &_tonemapLUT);
+	glBindTexture(GL_TEXTURE_1D, _tonemapLUT);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, N, 0, GL_RGB, GL_FLOAT, lut.data());
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	_tonemapLUTGamma = _screenGamma;
+}
+
+// Tonemaps the HDR target into the current viewport, through an LDR target when FXAA is on.
+// A reduced render scale is upscaled here by the bilinear fetch from the HDR target.
+// Background pixels are discarded and depth is written back for later GL drawing.
+inline void PBRRenderer::postPass() {
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	updateTonemapLUT();
+	glDepthFunc(GL_ALWAYS);
+	
+	Program& postProg = getPostProg();
+	_view->hdr.bindColor(postProg.progId, "hdrTex", 0);
+	_view->hdr.bindDepth(postProg.progId, "hdrDepth", 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_1D, _tonemapLUT);
+	postProg.setUniform("tonemapLUT", 2);
+	postProg.setUniform("sRGB2ScreenRGB", _sRGB2Screen );
+	if( _fxaa ) {
+		GLfloat oldClear[4];
+		glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClear);
+		GLboolean oldBlend = glIsEnabled(GL_BLEND);
+		glDisable(GL_BLEND);
+		_view->ldr.create(vp[2],vp[3]);
+		_view->ldr.setToTarget();
+		glClearColor(0,0,0,0);
+		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		postProg.setUniform("postViewport", vec4(0,0,vp[2],vp[3]) );
+		drawFullscreenTriangle();
+		_view->ldr.restoreVP();
+		glClearColor(oldClear[0],oldClear[1],oldClear[2],oldClear[3]);
+		if( oldBlend ) glEnable(GL_BLEND);
+		
+		Program& fxaaProg = getFXAAProg();
+		_view->ldr.bindColor(fxaaProg.progId, "ldrTex", 0);
+		_view->hdr.bindDepth(fxaaProg.progId, "hdrDepth", 1);
+		fxaaProg.setUniform("postViewport", vec4(vp[0],vp[1],vp[2],vp[3]) );
+		drawFullscreenTriangle();
+	}
+	else {
+		postProg.setUniform("postViewport", vec4(vp[0],vp[1],vp[2],vp[3]) );
+		drawFullscreenTriangle();
+	}
+	glDepthFunc(GL_LEQUAL);
 }
 
 inline Program& PBRRenderer::getRenderProg() {
@@ -157,6 +738,38 @@ inline Program& PBRRenderer::getConstProg() {
 	return _const_Prog;
 }
 
+inline Program& PBRRenderer::getShadowClassProg() {
+	static AutoBuildProgram _class_Prog = {__shader_vert_code__,
+		__shader_frag_header__ + __shader_frag_lighting_point_header__
+		+ __shader_frag_shadow_PCSS__ + __shader_frag_shadow_classify__};
+	_class_Prog.use();
+	return _class_Prog;
+}
+
+inline Program& PBRRenderer::getPostProg() {
+	static AutoBuildProgram _post_Prog = {__fullscreen_vert_code__, __post_tonemap_frag_code__};
+	_post_Prog.use();
+	return _post_Prog;
+}
+
+inline Program& PBRRenderer::getFXAAProg() {
+	static AutoBuildProgram _fxaa_Prog = {__fullscreen_vert_code__, __post_fxaa_frag_code__};
+	_fxaa_Prog.use();
+	return _fxaa_Prog;
+}
+
+inline Program& PBRRenderer::getSSAOProg() {
+	static AutoBuildProgram _ssao_Prog = {__fullscreen_vert_code__, __ssao_frag_code__};
+	_ssao_Prog.use();
+	return _ssao_Prog;
+}
+
+inline Program& PBRRenderer::getCubeShadowProg() {
+	static AutoBuildProgram _cube_Prog = {__cube_shadow_vert_code__, __cube_shadow_geom_code__, __cube_shadow_frag_code__};
+	_cube_Prog.use();
+	return _cube_Prog;
+}
+
 inline	void PBRRenderer::addPointLight(PointLight&& l) {
 	_pointLights.push_back(l);
 }
@@ -171,6 +784,7 @@ const std::string __const_vert_code__ =
 "uniform mat4 viewMat = mat4(1);\n"
 "uniform mat4 projMat = mat4(1);\n"
 "uniform mat4 modelMat = mat4(1);\n"
+"invariant gl_Position;\n"
 "void main(void) {\n"
 "	vec4 worldPos4 = modelMat* vec4( in_Position, 1. );\n"
 "	gl_Position= projMat*viewMat* worldPos4;\n"
@@ -186,12 +800,108 @@ const std::string __const_frag_code__ =
 "//	out_Color = vec4( vec3(gl_FragCoord.z), color.a);\n"
 "}\n";
 
+// Full-screen triangle from gl_VertexID; needs only an empty vertex array
+const std::string __fullscreen_vert_code__ =
+"#version 410 core\n"
+"void main(void) {\n"
+"	vec2 p = vec2( (gl_VertexID<<1)&2, gl_VertexID&2 );\n"
+"	gl_Position = vec4( p*2-1, 0, 1 );\n"
+"}\n";
+
+const std::string __post_tonemap_frag_code__ =
+"#version 410 core\n"
+"uniform sampler2D hdrTex;\n"
+"uniform sampler2D hdrDepth;\n"
+"uniform sampler1D tonemapLUT;\n"
+"uniform mat3 sRGB2ScreenRGB=mat3(1);\n"
+"uniform vec4 postViewport;\n"
+"out vec4 out_Color;\n"
+"void main(void) {\n"
+"	vec2 uv = (gl_FragCoord.xy-postViewport.xy)/postViewport.zw;\n"
+"	float depth = texture( hdrDepth, uv ).r;\n"
+"	if( depth>=1 ) discard;\n"
+"	vec4 c = texture( hdrTex, uv );\n"
+"	float n = float(textureSize( tonemapLUT, 0 ));\n"
+"	vec3 s = sqrt( clamp( sRGB2ScreenRGB*c.rgb, 0, 1 ) )*(n-1)/n+.5/n;\n"
+"	out_Color = vec4( texture( tonemapLUT, s.r ).r, texture( tonemapLUT, s.g ).g, texture( tonemapLUT, s.b ).b, c.a );\n"
+"	gl_FragDepth = depth;\n"
+"}\n";
+
+const std::string __post_fxaa_frag_code__ =
+"#version 410 core\n"
+"uniform sampler2D ldrTex;\n"
+"uniform sampler2D hdrDepth;\n"
+"uniform vec4 postViewport;\n"
+"out vec4 out_Color;\n"
+"const float FXAA_SPAN_MAX = 8.0;\n"
+"const float FXAA_REDUCE_MUL = 1.0/8.0;\n"
+"const float FXAA_REDUCE_MIN = 1.0/128.0;\n"
+"void main(void) {\n"
+"	vec2 uv = (gl_FragCoord.xy-postViewport.xy)/postViewport.zw;\n"
+"	vec2 rcp = 1./postViewport.zw;\n"
+"	vec4 rgbaM = texture( ldrTex, uv );\n"
+"	float depth = texture( hdrDepth, uv ).r;\n"
+"	if( depth>=1 && rgbaM.a<=0 ) discard;\n"
+"	const vec3 luma = vec3(0.299, 0.587, 0.114);\n"
+"	float lumaNW = dot( texture( ldrTex, uv+vec2(-1,-1)*rcp ).rgb, luma );\n"
+"	float lumaNE = dot( texture( ldrTex, uv+vec2( 1,-1)*rcp ).rgb, luma );\n"
+"	float lumaSW = dot( texture( ldrTex, uv+vec2(-1, 1)*rcp ).rgb, luma );\n"
+"	float lumaSE = dot( texture( ldrTex, uv+vec2( 1, 1)*rcp ).rgb, luma );\n"
+"	float lumaM  = dot( rgbaM.rgb, luma );\n"
+"	float lumaMin = min( lumaM, min( min( lumaNW, lumaNE ), min( lumaSW, lumaSE ) ) );\n"
+"	float lumaMax = max( lumaM, max( max( lumaNW, lumaNE ), max( lumaSW, lumaSE ) ) );\n"
+"	vec2 dir = vec2( -((lumaNW+lumaNE)-(lumaSW+lumaSE)), ((lumaNW+lumaSW)-(lumaNE+lumaSE)) );\n"
+"	float dirReduce = max( (lumaNW+lumaNE+lumaSW+lumaSE)*(0.25*FXAA_REDUCE_MUL), FXAA_REDUCE_MIN );\n"
+"	float rcpDirMin = 1./(min( abs(dir.x), abs(dir.y) )+dirReduce);\n"
+"	dir = clamp( dir*rcpDirMin, -FXAA_SPAN_MAX, FXAA_SPAN_MAX )*rcp;\n"
+"	vec4 rgbaA = .5*( texture( ldrTex, uv+dir*(1./3.-.5) )+texture( ldrTex, uv+dir*(2./3.-.5) ) );\n"
+"	vec4 rgbaB = rgbaA*.5+.25*( texture( ldrTex, uv-dir*.5 )+texture( ldrTex, uv+dir*.5 ) );\n"
+"	float lumaB = dot( rgbaB.rgb, luma );\n"
+"	out_Color = ( lumaB<lumaMin || lumaB>lumaMax )? rgbaA : rgbaB;\n"
+"	gl_FragDepth = depth;\n"
+"}\n";
+
+// Layered cube shadow: the geometry shader is instanced once per face and
+// writes the distance to the light, normalized by zFar, as the depth
+const std::string __cube_shadow_vert_code__ =
+"#version 410 core\n"
+"layout(location=0) in vec3 in_Position;\n"
+"uniform mat4 modelMat = mat4(1);\n"
+"void main(void) {\n"
+"	gl_Position = modelMat* vec4( in_Position, 1. );\n"
+"}\n";
+
+const std::string __cube_shadow_geom_code__ =
+"#version 410 core\n"
+"layout(triangles, invocations=6) in;\n"
+"layout(triangle_strip, max_vertices=3) out;\n"
+"uniform mat4 cubeVP[6];\n"
+"out vec3 worldPos;\n"
+"void main(void) {\n"
+"	for( int k=0; k<3; k++ ) {\n"
+"		worldPos = gl_in[k].gl_Position.xyz;\n"
+"		gl_Position = cubeVP[gl_InvocationID]*gl_in[k].gl_Position;\n"
+"		gl_Layer = gl_InvocationID;\n"
+"		EmitVertex();\n"
+"	}\n"
+"	EndPrimitive();\n"
+"}\n";
+
+const std::string __cube_shadow_frag_code__ =
+"#version 410 core\n"
+"in vec3 worldPos;\n"
+"uniform vec3 lightPos;\n"
+"uniform float zFar = 1000;\n"
+"void main(void) {\n"
+"	gl_FragDepth = length( worldPos-lightPos )/zFar;\n"
+"}\n";
+
 const std::string __shader_vert_code__ =
 "#version 410 core\n"
 "layout(location=0) in vec3 in_Position;\n"
 "layout(location=1) in vec3 in_Normal;\n"
 "layout(location=2) in vec2 in_TexCoord;\n"
-"#define MAX_N_LIGHTS 1\n"
+"#define MAX_N_LIGHTS 2\n"
 "uniform mat4 viewMat = mat4(1);\n"
 "uniform mat4 projMat = mat4(1);\n"
 "uniform mat4 modelMat = mat4(1);\n"
@@ -201,6 +911,7 @@ const std::string __shader_vert_code__ =
 "out vec4 shadowCoord[MAX_N_LIGHTS];\n"
 "out vec3 worldPos;\n"
 "out vec2 texCoord;\n"
+"invariant gl_Position;\n"
 "void main(void) {\n"
 "	vec4 worldPos4 = modelMat* vec4( in_Position, 1. );\n"
 "	normal    = normalize( (modelMat* vec4(in_Normal,0)).xyz );\n"
@@ -237,15 +948,39 @@ const std::string __shader_frag_shadow_header__ =
 "	float searchR;\n"
 "	mat4  proj;\n"
 "	sampler2D map;\n"
+"	int   cube;\n"
+"	vec3  pos;\n"
+"	samplerCube cubeMap;\n"
 "};\n"
 "uniform Shadower shadowers[MAX_N_LIGHTS];\n"
+"#ifndef SHADOW_COORD_DECLARED\n"
 "in vec4 shadowCoord[MAX_N_LIGHTS];\n"
+"#endif\n"
 "float rand(vec2 co){ return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453); }\n"
 "vec2 vogelSample( int i, int cnt, float offset) {\n"
 "	const float GoldenAngle = 2.4;\n"
 "	float idx = float(i);\n"
 "	float theta = idx*GoldenAngle+offset;\n"
 "	return vec2( cos(theta), sin( theta ) ) * pow((sqrt(idx+0.1)/sqrt(float(cnt))),1);\n"
+"}\n"
+"uniform int nCubeShadowSamples = 32;\n"
+"float cubeShadow( int i, vec3 n, vec3 l ) {\n"
+"	vec3 d = worldPos-shadowers[i].pos;\n"
+"	float dist = length( d );\n"
+"	vec3 D = d/dist;\n"
+"	vec3 T = normalize( cross( D, abs(D.y)<.99?vec3(0,1,0):vec3(1,0,0) ) );\n"
+"	vec3 B = cross( D, T );\n"
+"	float bias = (clamp(tan(acos(dot(n,l))),0,2)+1)*0.001;\n"
+"	float depth = dist/shadowers[i].zFar-bias;\n"
+"	float r = shadowers[i].radius/dist*.5;\n"
+"	float randomNumber = rand( gl_FragCoord.xy )*PI;\n"
+"	float sampleVis = 1./float(nCubeShadowSamples);\n"
+"	float vis = 1;\n"
+"	for( int k=0; k<nCubeShadowSamples; k++ ) {\n"
+"		vec2 o = vogelSample( k, nCubeShadowSamples, randomNumber )*r;\n"
+"		if( texture( shadowers[i].cubeMap, D+o.x*T+o.y*B ).r < depth ) vis -= sampleVis;\n"
+"	}\n"
+"	return vis;\n"
 "}\n";
 
 const std::string __shader_frag_lighting_point_header__ =
@@ -255,7 +990,7 @@ const std::string __shader_frag_lighting_point_header__ =
 "	vec3  intensity;\n"
 "	float cosFov;\n"
 "};\n"
-"#define MAX_N_LIGHTS 1\n"
+"#define MAX_N_LIGHTS 2\n"
 "uniform Light lights[MAX_N_LIGHTS];"
 "uniform int nLights = 1;\n";
 
@@ -269,8 +1004,9 @@ const std::string __shader_frag_main__ =
 "		float shadowing = computeShadowing( i, normalize(lights[i].pos-worldPos), normal );\n"
 "		c += computePointLighting(N, V, color.rgb, arm, f0, i ) * shadowing;\n"
 "	}\n"
+"	c += computeClusteredLighting(N, V, color.rgb, arm, f0 );\n"
 "	float ambOcc = computeAmbOcc()*arm.r;\n"
-"	vec3 am = computeAmbient( color.rgb, arm, N )*ambOcc;\n"
+"	vec3 am = computeAmbient( N, V, color.rgb, arm, f0 )*ambOcc;\n"
 "	out_Color = vec4( computeTonemap( c+am ), color.a);\n"
 "}\n";
 
@@ -288,6 +1024,7 @@ const std::string __shader_frag_main__ =
 
 const std::string __shader_frag_tonemap__ =
 "uniform int useAdvancedTonemap=1;\n"
+"uniform int linearOutput=0;\n"
 "uniform vec3 screenGamma=vec3(2.4);\n"
 "uniform mat3 sRGB2ScreenRGB=mat3(1);\n"
 "float tonemap_sRGB(float u) {\n"
@@ -314,6 +1051,7 @@ const std::string __shader_frag_tonemap__ =
 "	return csc*vec3(inverseTonemap(rgb.r,gamma.r),inverseTonemap(rgb.g,gamma.g),inverseTonemap(rgb.b,gamma.b));\n"
 "}\n"
 "vec3 computeTonemap( vec3 c) {\n"
+"	if( linearOutput> 0 )		return c;\n"
 "	if( useAdvancedTonemap> 0 )	return tonemap(c,sRGB2ScreenRGB,screenGamma);\n"
 "	else						return pow(c,vec3(1/2.2));\n"
 "}\n";
@@ -459,18 +1197,57 @@ __shader_frag_lighting_point_header__+
 
 
 
+// Unshadowed lights from the cluster containing the fragment. Needs BRDF() from the
+// Phong or PBR snippet; the range window brings each light smoothly to zero at its cull distance
+const std::string __shader_frag_lighting_clustered__ =
+"uniform samplerBuffer clusterData;\n"
+"uniform int   clusterEnabled = 0;\n"
+"uniform ivec2 clusterOffsets;\n"
+"uniform ivec3 clusterDims;\n"
+"uniform vec2  clusterDepth;\n"
+"uniform vec4  clusterViewport;\n"
+"uniform mat4  viewMat = mat4(1);\n"
+"vec3 computeClusteredLighting( vec3 N, vec3 V, vec3 color, vec3 arm, vec3 f0 ) {\n"
+"	if( clusterEnabled<1 ) return vec3(0);\n"
+"	vec2 uv = clamp( (gl_FragCoord.xy-clusterViewport.xy)/clusterViewport.zw, 0, 0.9999 );\n"
+"	float z = max( -(viewMat*vec4(worldPos,1)).z, clusterDepth.x );\n"
+"	int k = clamp( int( log( z/clusterDepth.x )/clusterDepth.y*clusterDims.z ), 0, clusterDims.z-1 );\n"
+"	ivec2 ij = ivec2( uv*vec2(clusterDims.xy) );\n"
+"	int cl = (k*clusterDims.y+ij.y)*clusterDims.x+ij.x;\n"
+"	ivec2 header = ivec2( texelFetch( clusterData, clusterOffsets.x+cl ).xy );\n"
+"	vec3 c = vec3(0);\n"
+"	for( int n=0; n<header.y; n++ ) {\n"
+"		int m = header.x+n;\n"
+"		int li = int( texelFetch( clusterData, clusterOffsets.y+m/4 )[m%4] )*3;\n"
+"		vec4 p = texelFetch( clusterData, li );\n"
+"		vec4 I = texelFetch( clusterData, li+1 );\n"
+"		vec3 dir = texelFetch( clusterData, li+2 ).xyz;\n"
+"		vec3 l = p.xyz-worldPos;\n"
+"		float d2 = dot( l, l );\n"
+"		vec3 L = l*inversesqrt( d2 );\n"
+"		float r2 = d2/(p.w*p.w);\n"
+"		float w = clamp( 1-r2*r2, 0, 1 );\n"
+"		float spotFactor = smoothstep( I.w, I.w+.05f, dot( -L, dir ));\n"
+"		c += BRDF( N, L, V, arm.g, color, arm.b, f0 )*I.rgb/d2*spotFactor*w*w;\n"
+"	}\n"
+"	return c;\n"
+"}\n";
+
+const std::string __shader_frag_lighting_clustered_null__ =
+"vec3 computeClusteredLighting( vec3 N, vec3 V, vec3 color, vec3 arm, vec3 f0 ) { return vec3(0); }\n";
+
 const std::string __shader_frag_shadow_null__ =
 "float computeShadowing( int i, vec3 n, vec3 l ) { return 1; }\n";
 
 const std::string __shader_frag_shadow_PCF__ =
 __shader_frag_shadow_header__+
-"const int N_SHADOW_SAMPLE = 64;\n"
+"uniform int nShadowSamples = 64;\n"
 "float sampleShadow(vec3 sCoord, float rad, float bias, sampler2D map, float randomNumber ) {\n"
-"	const float sampleVis = 1./float(N_SHADOW_SAMPLE);\n"
+"	float sampleVis = 1./float(nShadowSamples);\n"
 "	float vis = 1;\n"
 "	float r = max( rad, 0.0001 );\n"
-"	for (int i=0;i<N_SHADOW_SAMPLE;i++) {\n"
-"		vec2 offset = vogelSample( i, N_SHADOW_SAMPLE, randomNumber );\n"
+"	for (int i=0;i<nShadowSamples;i++) {\n"
+"		vec2 offset = vogelSample( i, nShadowSamples, randomNumber );\n"
 "		if( texture( map, sCoord.xy+ r*offset ).x < sCoord.z-bias ) vis -= sampleVis;\n"
 "	}\n"
 "	return vis;\n"
@@ -482,21 +1259,22 @@ __shader_frag_shadow_header__+
 "}\n"
 "float computeShadowing( int i, vec3 n, vec3 l ) {\n"
 "	if( shadowers[i].enabled <1 ) return 1;\n"
+"	if( shadowers[i].cube >0 ) return cubeShadow( i, n, l );\n"
 "	return PCF( shadowCoord[i].xyz/shadowCoord[i].w, shadowers[i].radius, 0.0005, shadowers[i].map, n, l );\n"
 "}\n";
 
 const std::string __shader_frag_shadow_PCSS__ =
 __shader_frag_shadow_header__+
-"const int N_SHADOW_SAMPLE = 64;\n"
-"const int N_BLOCKER_SAMPLE = 32;\n"
+"uniform int nShadowSamples = 64;\n"
+"uniform int nBlockerSamples = 32;\n"
 "float linearDepth( float d, float near, float far ) { return -2.0 * near * far / (far + near - (2.0 * d - 1.0) * (far - near)); }\n"
 "vec3 project( mat4 proj, vec3 p ) { vec4 pos = proj*vec4(p,1); return pos.xyz/pos.w; }\n"
 "float sampleShadow(vec3 sCoord, float rad, float bias, sampler2D map, float randomNumber ) {\n"
-"	const float sampleVis = 1./float(N_SHADOW_SAMPLE);\n"
+"	float sampleVis = 1./float(nShadowSamples);\n"
 "	float vis = 1;\n"
 "	float r = max( rad, 0.0001 );\n"
-"	for (int i=0;i<N_SHADOW_SAMPLE;i++) {\n"
-"		vec2 offset = vogelSample( i, N_SHADOW_SAMPLE, randomNumber );\n"
+"	for (int i=0;i<nShadowSamples;i++) {\n"
+"		vec2 offset = vogelSample( i, nShadowSamples, randomNumber );\n"
 "		if( texture( map, sCoord.xy+ r*offset ).x < sCoord.z-bias ) vis -= sampleVis;\n"
 "	}\n"
 "	return smoothstep(0.0f,0.8f,vis);\n"
@@ -505,8 +1283,8 @@ __shader_frag_shadow_header__+
 "float blockerSearch( vec3 sCoord, float searchR, float bias, sampler2D map, float randomNumber ) {\n"
 "	float blockerDepth = 0.;\n"
 "	int numBlockers = 0;\n"
-"	for( int i = 0; i < N_BLOCKER_SAMPLE; ++i ) {\n"
-"		vec2 offset = vogelSample( i, N_BLOCKER_SAMPLE, randomNumber );\n"
+"	for( int i = 0; i < nBlockerSamples; ++i ) {\n"
+"		vec2 offset = vogelSample( i, nBlockerSamples, randomNumber );\n"
 "		float shadowMapDepth = texture( map, sCoord.xy + searchR*offset ).r;\n"
 "		if ( shadowMapDepth < sCoord.z-bias ) {\n"
 "			blockerDepth += shadowMapDepth;\n"
@@ -516,8 +1294,25 @@ __shader_frag_shadow_header__+
 "	if (numBlockers < 1 ) return 0.001;\n"
 "	return blockerDepth / float(numBlockers);\n"
 "}\n"
-"float PCSS( vec3 sCoord, float radius, float sr, float bias, float near, float far, mat4 proj, sampler2D map, vec3 n, vec3 l ) {\n"
+"uniform sampler2D shadowClass;\n"
+"uniform int   shadowClassEnabled=0;\n"
+"uniform vec4  shadowClassViewport;\n"
+"// 0: lit, 1: umbra, otherwise penumbra. Bilinear taps around the pixel dilate the penumbra\n"
+"float lookupShadowClass( int i ) {\n"
+"	if( shadowClassEnabled<1 || i>3 ) return .5;\n"
+"	vec2 uv = (gl_FragCoord.xy-shadowClassViewport.xy)/shadowClassViewport.zw;\n"
+"	vec2 t = 1./vec2(textureSize( shadowClass, 0 ));\n"
+"	float c0 = texture( shadowClass, uv+vec2(-t.x,-t.y) )[i];\n"
+"	float c1 = texture( shadowClass, uv+vec2( t.x,-t.y) )[i];\n"
+"	float c2 = texture( shadowClass, uv+vec2(-t.x, t.y) )[i];\n"
+"	float c3 = texture( shadowClass, uv+vec2( t.x, t.y) )[i];\n"
+"	if( max(max(c0,c1),max(c2,c3))<0.01 ) return 0;\n"
+"	if( min(min(c0,c1),min(c2,c3))>0.99 ) return 1;\n"
+"	return .5;\n"
+"}\n"
+"float PCSS( vec3 sCoord, float radius, float sr, float bias, float near, float far, mat4 proj, sampler2D map, vec3 n, vec3 l, float cls ) {\n"
 "	float tbias = clamp(tan(acos(dot(n,l))),0,2)*bias+bias;\n"
+"	if( cls<0.01 || cls>0.99 ) return texture( map, sCoord.xy ).x < sCoord.z-tbias ? 0 : 1;\n"
 "	float randomNumber = rand( gl_FragCoord.xy )*PI;\n"
 "	float zEye = -linearDepth( sCoord.z, near, far );\n"
 "	float searchR = radius*(zEye - near) / zEye/sr *.5;\n"
@@ -528,8 +1323,34 @@ __shader_frag_shadow_header__+
 "}\n"
 "float computeShadowing( int i, vec3 n, vec3 l ) {\n"
 "	if( shadowers[i].enabled <1 ) return 1;\n"
+"	if( shadowers[i].cube >0 ) return cubeShadow( i, n, l );\n"
 "	return PCSS( shadowCoord[i].xyz/shadowCoord[i].w, shadowers[i].radius, shadowers[i].searchR, 0.0005,\n"
-"				shadowers[i].zNear, shadowers[i].zFar, shadowers[i].proj, shadowers[i].map, n, l );\n"
+"				shadowers[i].zNear, shadowers[i].zFar, shadowers[i].proj, shadowers[i].map, n, l, lookupShadowClass(i) );\n"
+"}\n";
+
+// Main function of the classification pre-pass. Blocker search over twice the PCSS search
+// radius: no blockers means lit, all blockers means umbra
+const std::string __shader_frag_shadow_classify__ =
+"const int N_CLASS_SAMPLE = 16;\n"
+"float classifyShadow( int i ) {\n"
+"	if( shadowers[i].enabled<1 || shadowers[i].cube>0 ) return 0;\n"
+"	vec3 sCoord = shadowCoord[i].xyz/shadowCoord[i].w;\n"
+"	float near = shadowers[i].zNear, far = shadowers[i].zFar;\n"
+"	float zEye = -linearDepth( sCoord.z, near, far );\n"
+"	float searchR = shadowers[i].radius*(zEye - near) / zEye/shadowers[i].searchR;\n"
+"	int numBlockers = 0;\n"
+"	for( int k=0; k<N_CLASS_SAMPLE; k++ ) {\n"
+"		vec2 offset = vogelSample( k, N_CLASS_SAMPLE, 0 );\n"
+"		if( texture( shadowers[i].map, sCoord.xy + searchR*offset ).r < sCoord.z-0.001 ) numBlockers++;\n"
+"	}\n"
+"	if( numBlockers==0 ) return 0;\n"
+"	if( numBlockers==N_CLASS_SAMPLE ) return 1;\n"
+"	return .5;\n"
+"}\n"
+"void main(void) {\n"
+"	vec4 cls = vec4(0);\n"
+"	for( int i=0; i<nLights && i<4; i++ ) cls[i] = classifyShadow( i );\n"
+"	out_Color = cls;\n"
 "}\n";
 
 
@@ -545,11 +1366,11 @@ __shader_frag_shadow_header__+
 const std::string __shader_frag_ambient_const__ =
 "uniform vec3  ambCoeffs[9];\n"
 "uniform float ambFactor = .25;\n"
-"vec3 computeAmbient( vec3 color, vec3 arm, vec3 N ) {\n"
+"vec3 computeAmbient( vec3 N, vec3 V, vec3 color, vec3 arm, vec3 f0 ) {\n"
 "	return color*mix(1.f,0.2f,arm.b)*ambCoeffs[0]*ambFactor/PI*2;\n"
 "}\n";
 
-const std::string __shader_frag_ambient_spherical__ =
+const std::string __shader_frag_ambient_SH__ =
 "vec3 evalSphericalHarmonic( vec3 N, vec3 coeff[9] ) {\n"
 "	const float iblRotationTheta = 0.;\n"
 "	float c = cos( iblRotationTheta ), s = sin( iblRotationTheta );\n"
@@ -562,16 +1383,102 @@ const std::string __shader_frag_ambient_spherical__ =
 "	return col;\n"
 "}\n"
 "uniform vec3  ambCoeffs[9];\n"
-"uniform float ambFactor = .25;\n"
-"vec3 computeAmbient( vec3 color, vec3 arm, vec3 N ) {\n"
+"uniform float ambFactor = .25;\n";
+
+const std::string __shader_frag_ambient_spherical__ =
+__shader_frag_ambient_SH__ +
+"vec3 computeAmbient( vec3 N, vec3 V, vec3 color, vec3 arm, vec3 f0 ) {\n"
 "	return color*mix(1.f,0.2f,arm.b)*evalSphericalHarmonic(N,ambCoeffs).rgb*ambFactor/PI*2;\n"
 "}\n";
 
+// Split-sum specular from EnvironmentMap; ambCoeffs then hold its irradiance/PI.
+// Falls back to the spherical ambient until a map is loaded
+const std::string __shader_frag_ambient_IBL__ =
+__shader_frag_ambient_SH__ +
+"uniform sampler2DArray envMap;\n"
+"uniform int   envEnabled = 0;\n"
+"uniform float envLevels = 1;\n"
+"uniform float envIntensity = 1;\n"
+"vec2 equirectUV( vec3 d ) {\n"
+"	return vec2( atan( d.x, -d.z )/(2*PI), 1-acos( clamp( d.y, -1, 1 ) )/PI );\n"
+"}\n"
+"vec3 computeAmbient( vec3 N, vec3 V, vec3 color, vec3 arm, vec3 f0 ) {\n"
+"	vec3 irradiance = evalSphericalHarmonic(N,ambCoeffs).rgb;\n"
+"	if( envEnabled<1 ) return color*mix(1.f,0.2f,arm.b)*irradiance*ambFactor/PI*2;\n"
+"	float NoV = clamp( dot( N, V ), 1e-3, 1 );\n"
+"	vec2 lutSize = vec2( textureSize( envMap, 0 ).xy );\n"
+"	vec2 ab = textureLod( envMap, vec3( (vec2( NoV, arm.g )*(lutSize-1)+.5)/lutSize, 1 ), 0 ).rg;\n"
+"	vec3 spec = textureLod( envMap, vec3( equirectUV( reflect( -V, N ) ), 0 ), arm.g*(envLevels-1) ).rgb;\n"
+"	vec3 F0 = mix( f0, color, arm.b );\n"
+"	return (color*(1-arm.b)*max( irradiance, vec3(0) )+spec*(F0*ab.x+ab.y))*envIntensity;\n"
+"}\n";
+
 const std::string __shader_frag_ambOcc_null__ =
 "float computeAmbOcc() {\n"
 "	return 1;\n"
 "}\n";
 
+// Bilateral upsample of the half resolution SSAO: bilinear weights damped by the depth difference
+const std::string __shader_frag_ambOcc_SSAO__ =
+"uniform sampler2D ssaoTex;\n"
+"uniform int   ssaoEnabled = 0;\n"
+"uniform vec4  ssaoViewport;\n"
+"uniform mat4  ssaoView;\n"
+"float computeAmbOcc() {\n"
+"	if( ssaoEnabled<1 ) return 1;\n"
+"	float z = -(ssaoView*vec4(worldPos,1)).z;\n"
+"	ivec2 ts = textureSize( ssaoTex, 0 );\n"
+"	vec2 p = (gl_FragCoord.xy-ssaoViewport.xy)/ssaoViewport.zw*vec2(ts)-.5;\n"
+"	vec2 f = fract( p );\n"
+"	ivec2 b = ivec2( floor( p ) );\n"
+"	float sum = 0, wsum = 0;\n"
+"	for( int j=0; j<2; j++ ) for( int i=0; i<2; i++ ) {\n"
+"		vec2 s = texelFetch( ssaoTex, clamp( b+ivec2(i,j), ivec2(0), ts-1 ), 0 ).rg;\n"
+"		float w = (i==0?1-f.x:f.x)*(j==0?1-f.y:f.y)*exp( -abs(z-s.g)/(0.02*z) )+1e-4;\n"
+"		sum += s.r*w;\n"
+"		wsum += w;\n"
+"	}\n"
+"	return sum/wsum;\n"
+"}\n";
+
+const std::string __ssao_frag_code__ =
+"#version 410 core\n"
+"const float PI = 3.1415926;\n"
+"const int N_SSAO_SAMPLE = 8;\n"
+"uniform sampler2D depthTex;\n"
+"uniform mat4  projMat;\n"
+"uniform mat4  invProj;\n"
+"uniform float radius = 10;\n"
+"uniform vec2  aoSize;\n"
+"out vec4 out_Color;\n"
+"vec3 viewPos( vec2 uv ) {\n"
+"	vec4 p = invProj*vec4( vec3( uv, texture( depthTex, uv ).r )*2-1, 1 );\n"
+"	return p.xyz/p.w;\n"
+"}\n"
+"float gradientNoise( vec2 p ) { return fract( 52.9829189*fract( dot( p, vec2(0.06711056,0.00583715) ) ) ); }\n"
+"void main(void) {\n"
+"	vec2 uv = gl_FragCoord.xy/aoSize;\n"
+"	if( texture( depthTex, uv ).r>=1 ) { out_Color = vec4( 1, 1e6, 0, 1 ); return; }\n"
+"	vec3 P = viewPos( uv );\n"
+"	vec3 N = normalize( cross( dFdx(P), dFdy(P) ) );\n"
+"	if( N.z<0 ) N = -N;\n"
+"	vec3 T = normalize( cross( N, abs(N.y)<.99?vec3(0,1,0):vec3(1,0,0) ) );\n"
+"	vec3 B = cross( N, T );\n"
+"	float noise = gradientNoise( gl_FragCoord.xy );\n"
+"	float occ = 0;\n"
+"	for( int i=0; i<N_SSAO_SAMPLE; i++ ) {\n"
+"		float t = (float(i)+noise)/float(N_SSAO_SAMPLE);\n"
+"		float theta = float(i)*2.4+noise*2*PI;\n"
+"		vec3 dir = (T*cos(theta)+B*sin(theta))*sqrt(t)+N*sqrt(1-t);\n"
+"		vec3 S = P+dir*radius*mix( .2, 1., t );\n"
+"		vec4 q = projMat*vec4( S, 1 );\n"
+"		float sz = viewPos( q.xy/q.w*.5+.5 ).z;\n"
+"		float range = smoothstep( 0, 1, radius/abs(P.z-sz) );\n"
+"		occ += (sz>=S.z+0.02*radius?1:0)*range;\n"
+"	}\n"
+"	out_Color = vec4( 1-occ/float(N_SSAO_SAMPLE), -P.z, 0, 1 );\n"
+"}\n";
+
 
 const std::string __shader_frag_material__ =
 "uniform vec4  color = vec4(1);\n"
@@ -614,11 +1521,12 @@ const std::string __shader_frag_code__ =
 __shader_frag_header__
 + __shader_frag_tonemap__
 + __shader_frag_normal__
-+ __shader_frag_ambient_spherical__
++ __shader_frag_ambient_IBL__
 + __shader_frag_lighting_point_PBR__
++ __shader_frag_lighting_clustered__
 + __shader_frag_shadow_PCSS__
 //+ __shader_frag_shadow_null__
-+ __shader_frag_ambOcc_null__
++ __shader_frag_ambOcc_SSAO__
 + __shader_frag_material__
 + __shader_frag_main__;
 
@@ -629,6 +1537,7 @@ __shader_frag_header__
 + __shader_frag_normal__
 + __shader_frag_ambient_spherical__
 + __shader_frag_lighting_point_Lambertian__
++ __shader_frag_lighting_clustered_null__
 + __shader_frag_shadow_PCF__
 + __shader_frag_ambOcc_null__
 + __shader_frag_material__
@@ -673,6 +1582,7 @@ const std::string __shader_frag_code__ =
 "\n"
 "\n"
 "uniform int useAdvancedTonemap=1;\n"
+"uniform int linearOutput=0;\n"
 "uniform vec3 screenGamma=vec3(2.4);\n"
 "uniform mat3 sRGB2ScreenRGB=mat3(1);\n"
 "float tonemap_sRGB(float u) {\n"
@@ -699,6 +1609,7 @@ const std::string __shader_frag_code__ =
 "	return csc*vec3(inverseTonemap(rgb.r,gamma.r),inverseTonemap(rgb.g,gamma.g),inverseTonemap(rgb.b,gamma.b));\n"
 "}\n"
 "vec3 computeTonemap( vec3 c) {\n"
+"	if( linearOutput> 0 )		return c;\n"
 "	if( useAdvancedTonemap> 0 )	return tonemap(c,sRGB2ScreenRGB,screenGamma);\n"
 "	else						return pow(c,vec3(1/2.2));\n"
 "}\n"
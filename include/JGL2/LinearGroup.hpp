@@ -74,9 +74,9 @@ inline void LinearGroup::add( Widget* w ) {
 inline void LinearGroup::resizable( Widget* w ) {
 	_resizable = w;
 	if( _resizable ) {
-		_resizable->changed();
+		_resizable->change();
 	}
-	changed();
+	change();
 }
 
 } // namespace JGL2
@@ -269,7 +269,7 @@ inline void MenuPan::draw(NVGcontext* vg) {
 				nvgSave(vg);
 				rct_t r( 0, 0, w()-horzPadding(), sz.h );
 				nvgTranslate(vg,leftPadding(),yy);
-				nvgScissor(vg, 0, 0, r.w, r.h);
+				nvgIntersectScissor(vg, 0, 0, r.w, r.h);
 				i.draw(vg, r, align_t::LEFT|align_t::TOP_BOTTOM, count == _underMouseItem);
 				nvgRestore(vg);
 
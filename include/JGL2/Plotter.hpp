@@ -705,7 +705,7 @@ inline pos_t Plotter::toImage(const pos_t& p) const { return pos_t(_gridX.toImag
 
 inline void Plotter::drawGuideLabel(NVGcontext* vg, bool vert, const pos_t pt, const rct_t& screen, const str_t& str, float labelSz, float padding, float margin, float arrowLength, float arrowWidth ) {
 	float boxr = 3;
-	sz2_t tSz = nvgMeasureText(vg, str, labelSz);
+	sz2_t tSz = nvgMeasureText(vg, str, labelSz, _font_label());
 	rct_t box( 0, 0, tSz.w+padding*2, tSz.h+padding*2 );
 	box.x = std::min(screen.w-margin-box.w, std::max(margin,pt.x+(vert?(-box.w/2.f):(arrowLength+margin))) );
 	box.y = vert?(screen.h-box.h-margin):(pt.y-box.h/2);
@@ -750,7 +750,7 @@ inline void Plotter::drawGrids(NVGcontext* vg, const rct_t& r) {
 	float tw=0;
 	for( size_t i=0; i<_gridY.count; i++ ) {
 		auto [yy,label] = _gridY.getLabel(i);
-		tw = std::max(tw,nvgMeasureText(vg, label).w);
+		tw = std::max(tw,nvgMeasureText(vg, label, textSize(), _font_label()).w);
 	}
 
 	float labelY = std::max(2.f,std::min(r.h-textSize()-2,y0+2));
@@ -39,28 +39,28 @@ protected:
 inline void PropertyGroup::labelAlignment( align_t a ){
 	if( _labelAlignment!=a ) {
 		_labelAlignment = a;
-		changed();
+		change();
 	}
 }
 
 inline void PropertyGroup::actionAlignment( align_t a ){
 	if( _actionAlignment!=a ) {
 		_actionAlignment = a;
-		changed();
+		change();
 	}
 }
 
 inline void PropertyGroup::labelOffset(float off){
 	if( _labelOffset!=off ) {
 		_labelOffset = off;
-		changed();
+		change();
 	}
 }
 
 inline void PropertyGroup::labelPos(label_pos_t pos){
 	if( _labelPos!=pos ) {
 		_labelPos = pos;
-		changed();
+		change();
 	}
 }
 
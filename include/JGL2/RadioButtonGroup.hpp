@@ -134,7 +134,7 @@ inline void RadioButtonGroup::buttonValueChangedCB( Widget* w, void* ud ) {
 
 inline void	RadioButtonGroup::drawBox(NVGcontext* vg, const rct_t& r) {
 	nvgSave( vg );
-	_Scrollable* sc = dynamic_cast<_Scrollable*>(this);
+	_Scrollable* sc = scrollablePtr();
 	if( sc )
 		nvgTranslate(vg, -sc->scrollOffset().x, -sc->scrollOffset().y );
 	nvgSave( vg );
@@ -12,8 +12,8 @@
 
 namespace JGL2 {
 
-typedef std::function<void()> InitCB_t;
-typedef std::function<void(float)> FrameCB_t;
+typedef Delegate<void()> InitCB_t;
+typedef Delegate<void(float)> FrameCB_t;
 
 extern inline void draw_simulation_triangle_button( NVGcontext* vg, const rct_t&r, const NVGcolor& c, const pos_t& p1, const pos_t& p2, const pos_t& p3 );
 extern inline void draw_simulation_vert_bar_button( NVGcontext* vg, const rct_t&r, const NVGcolor& c, const pos_t& p1, const pos_t& p2 );
@@ -50,7 +50,7 @@ struct Simulation3DView: public Render3DView<T> {
 			else if( _JGL::eventKey() == '0' ) {
 				animating(false);
 				_initCB();
-				Render3DView<T>::redraw();
+				Render3DView<T>::sceneChanged();
 				return true;
 			}
 		}
@@ -73,7 +73,7 @@ struct Simulation3DView: public Render3DView<T> {
 			if( prevBtnRect().in(pt) ) {
 				animating(false);
 				_initCB();
-				Render3DView<T>::redraw();
+				Render3DView<T>::sceneChanged();
 				_mouseOnButton = true;
 				return true;
 			}
@@ -92,11 +92,13 @@ struct Simulation3DView: public Render3DView<T> {
 	virtual inline void drawGL() override {
 		if( !_inited ) {
 			_initCB();
+			Render3DView<T>::renderer().sceneChanged();
 			_inited = true;
 		}
 		if( _animating ) {
 			float t = glfwGetTime();
 			_frameCB(t-_lastT);
+			Render3DView<T>::renderer().sceneChanged();
 			Render3DView<T>::animate();
 			_lastT = t;
 		}
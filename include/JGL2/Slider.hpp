@@ -152,7 +152,7 @@ template<typename T> inline  void Slider<T>::drawAction(NVGcontext* vg, const rc
 	}
 	if( _valueTipAlpha>0 ) {
 		nvgSave(vg);
-		nvgResetScissor(vg);
+		nvgResetToFrameScissor(vg);
 		str_t str = toString( value() );
 		sz2_t sz = nvgMeasureText(vg, str, _pt_tooltip_text(),_font_tooltip_text() );
 		rct_t rr;
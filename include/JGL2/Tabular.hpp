@@ -72,7 +72,7 @@ inline int Tabular::columns() const {
 }
 inline void Tabular::columns(int n) {
 	_columns = n;
-	changed();
+	change();
 }
 
 inline int Tabular::rows() const {
@@ -127,12 +127,7 @@ inline void Tabular::rearrangeChildren(NVGcontext* vg, const rct_t& r, autoscale
 
 
 inline void Tabular::rearrange(NVGcontext* vg,autoscale_t scaling) {
-	{
-		std::unique_lock<std::mutex> lock(_childMutex);
-		for( auto c: _children ) if( c ) {
-			if( c->changed() ) c->reform(vg,autoscale_t::ALL);
-		}
-	}
+	reformChangedChildren(vg);
 	autoscale_t sc = autoscale()&scaling;
 
 	if( changed() ) {
@@ -149,6 +144,7 @@ inline void Tabular::rearrange(NVGcontext* vg,autoscale_t scaling) {
 }
 
 inline sz2_t Tabular::minSize() const {
+	if( _minSizeValid ) return _minSizeCache;
 	int cs = columns();
 	int rs = rows();
 
@@ -170,7 +166,9 @@ inline sz2_t Tabular::minSize() const {
 	for( int i=0; i<widths .size(); i++ ) ww = ww+widths[i]+spacing();
 	for( int i=0; i<heights.size(); i++ ) hh = hh+heights[i]+spacing();
 
-	return sz2_t(ww-spacing(),hh-spacing());
+	_minSizeCache = sz2_t(ww-spacing(),hh-spacing());
+	_minSizeValid = true;
+	return _minSizeCache;
 }
 
 inline void Tabular::drawContents(NVGcontext* vg, const rct_t& r, align_t align) {
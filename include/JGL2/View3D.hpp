@@ -11,12 +11,16 @@
 #include <JGL2/Widget.hpp>
 #include <JGL2/JR_Camera3D.hpp>
 #include <JGL2/JR_Renderer.hpp>
+#include <JGL2/JR_DeferredRenderer.hpp>
 #include <JGL2/_Picker3D.hpp>
+#include <memory>
+#include <mutex>
 
 namespace JGL2 {
 
 struct View3D: Widget,  _Targettable, _Picker3D {
 	View3D( float x, float y, float w, float h, const std::string& n );
+	virtual ~View3D();
 	
 	template<typename T, typename=std::enable_if_t<std::is_base_of_v<JR::Camera, T>>>
 			inline	void				cameraType()		{ cameraType(new T()); }
@@ -32,6 +36,9 @@ struct View3D: Widget,  _Targettable, _Picker3D {
 	virtual inline	JR::Renderer&		renderer()			{ return *_renderer; }
 	virtual inline	const JR::Renderer&	renderer() const	{ return *_renderer; }
 	template<typename T> inline T*		renderer();
+	// Draws v's scene with this view's camera; scene update, lights and shadow maps
+	// are computed once per frame for all the views sharing it
+	virtual inline	void				shareScene(View3D& v);
 
 	virtual inline	void				clearColor( const colora_t& c ) { _clearColor = c; }
 	virtual inline	colora_t&			clearColor()		{ return _clearColor; }
@@ -47,7 +54,20 @@ struct View3D: Widget,  _Targettable, _Picker3D {
 	virtual inline	mat4				projMat()			{ return camera().projMat(size()); }
 	
 //	virtual inline 	void				setUniforms( GLuint prog )	{ camera().setUniforms( prog, size() ); }
-	virtual inline 	void				drawContents(NVGcontext* vg, const rct_t&r, align_t a ) override {}
+	virtual inline 	void				drawContents(NVGcontext* vg, const rct_t&r, align_t a ) override;
+	
+	// Renders on _JGL::renderThread() into offscreen frames that drawGL() only blits, so
+	// input and playback stay responsive during long frames. renderFunc and updateFunc
+	// then run on the render thread; snapshotFunc runs on the UI thread while this view
+	// has no frame in flight and is the place to copy UI-side state they read.
+	// Picking reads the depth of the frame on screen, which may lag the camera by a frame
+	virtual inline	void				threadedRendering(bool b);
+	virtual inline	bool				threadedRendering() const	{ return _threaded; }
+	virtual inline	void				snapshotFunc(JR::RenderFunc f) { _snapshotFunc = f; }
+	
+	// Overlays the renderer's GPU time per pass
+	virtual inline	void				showPassTimes(bool b)		{ _showPassTimes = b; redraw(); }
+	virtual inline	bool				showPassTimes() const		{ return _showPassTimes; }
 
 	virtual 		bool				handle( event_t e ) override;
 	
@@ -58,11 +78,53 @@ struct View3D: Widget,  _Targettable, _Picker3D {
 	virtual inline	void				wireFunc(JR::RenderFunc f)	{ _renderer->wireFunc(f); }
 	virtual inline	void				resetWireFunc()				{ _renderer->resetWireFunc(); }
 	
+	virtual inline	void				staticFunc(JR::RenderFunc f){ _renderer->staticFunc(f); }
+	virtual inline	void				resetStaticFunc()			{ _renderer->resetStaticFunc(); }
+	
+	virtual inline	void				updateFunc(JR::RenderFunc f){ _renderer->updateFunc(f); }
+	virtual inline	void				resetUpdateFunc()			{ _renderer->resetUpdateFunc(); }
+	
+	// Call when the scene drawn by renderFunc is modified outside the timeline/picker
+	virtual inline	void				sceneChanged()				{ _renderer->sceneChanged(); redraw(); }
+	virtual inline	void				staticSceneChanged()		{ _renderer->staticSceneChanged(); redraw(); }
+	
 protected:
 	JR::Camera*		_camera = nullptr;
-	JR::Renderer*	_renderer = nullptr;
+	std::shared_ptr<JR::Renderer>	_renderer;
 
 	bool			_cameraMotion = false;
+	bool			_showPassTimes = false;
+	bool			_passTimesRefresh = false;
+	
+	// Triple-buffered frames for threaded rendering: one shown, one ready, one being written
+	struct _AsyncFrame {
+		JR::FramebufferObj	target = JR::FramebufferObj(GL_RGBA8);
+		GLsync				written = nullptr;	// Set by the render thread
+		GLsync				read = nullptr;		// Set by the UI thread after the blit
+		GLuint				readFBO = 0;		// UI context wrapper of target's color and depth
+		GLuint				readTex = 0;
+		int					w = 0, h = 0;
+	};
+	bool			_threaded = false;
+	_AsyncFrame		_frames[3];
+	std::mutex		_frameMutex;
+	int				_shownFrame = -1, _readyFrame = -1;
+	GLint			_shownVP[4] = {};	// Where the shown frame was blitted
+	bool			_inFlight = false;
+	JR::Camera		_renderCamera;
+	mat4			_lastView, _lastProj;
+	size_t			_lastVersion = 0, _lastStaticVersion = 0;
+	int				_lastW = 0, _lastH = 0;
+	JR::RenderFunc	_snapshotFunc = [](){};
+	std::shared_ptr<View3D*>	_self = std::make_shared<View3D*>(this);	// Expires with the view
+	
+	size_t			_redrawTimer = 0;
+	// Redraws once after delay seconds, for results that arrive without an event
+	virtual inline	void				scheduleRedraw(double delay);
+	virtual inline	void				drawThreaded();
+	virtual inline	void				blitFrame(_AsyncFrame& f);
+	virtual inline	void				releaseThreaded();
+	virtual inline	float				readDepth(const pos_t& pt) override;
 	pos_t			_cursorPt;
 	colora_t		_clearColor = colora_t(0,0,0,0);
 };
@@ -70,32 +132,242 @@ protected:
 inline View3D::View3D( float x, float y, float w, float h, const std::string& n )
 : _Picker3D(), Widget(x,y,w,h,n) {
 	_camera = new JR::OrbitCamera();
-	_renderer = new JR::NullRenderer();
+	_renderer = std::make_shared<JR::NullRenderer>();
+}
+
+inline View3D::~View3D() {
+	if( _redrawTimer ) _JGL::removeTimer( _redrawTimer );
+	releaseThreaded();
+	if( _renderer ) _renderer->releaseView(_camera);
+	delete _camera;
 }
 
 inline void View3D::camera( JR::Camera* c ) {
 	assert( c );
+	_lastView = mat4(0);
 	if( _camera ) {
 		c->copyFrom(_camera);
+		if( _renderer ) _renderer->releaseView(_camera);
 		delete _camera;
 	}
 	_camera = c;
 }
 
 inline void View3D::renderer(JR::Renderer* r) {
+	bool threaded = _threaded;
+	threadedRendering( false );
 	if( _renderer ) {
-		r->copyFrom(_renderer);
-		delete _renderer;
+		r->copyFrom(*_renderer);
+		_renderer->releaseView(_camera);
 	}
-	_renderer = r;
+	_renderer.reset(r);
+	threadedRendering( threaded );
+}
+
+inline void View3D::shareScene(View3D& v) {
+	if( _renderer == v._renderer ) return;
+	bool threaded = _threaded;
+	threadedRendering( false );
+	if( _renderer ) _renderer->releaseView(_camera);
+	_renderer = v._renderer;
+	threadedRendering( threaded );
 }
 
 inline void View3D::drawGL() {
+	// E.g. an environment map decoding on the worker pool
+	if( _renderer && _renderer->pendingWork() ) scheduleRedraw( .1 );
+	if( _threaded && _renderer ) {
+		drawThreaded();
+		return;
+	}
 	glClearColor(_clearColor.r,_clearColor.b,_clearColor.g,_clearColor.a);
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
 	if( _renderer ) _renderer->render(size(),camera());
 }
 
+inline void View3D::scheduleRedraw(double delay) {
+	if( _redrawTimer ) return;
+	_redrawTimer = _JGL::addTimer( delay, [this]() { _redrawTimer = 0; redraw(); } );
+}
+
+inline void View3D::threadedRendering(bool b) {
+	if( b == _threaded ) return;
+	if( !b ) releaseThreaded();
+	_threaded = b;
+	redraw();
+}
+
+inline void View3D::drawThreaded() {
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	int slot = -1;
+	{
+		std::unique_lock<std::mutex> lock(_frameMutex);
+		if( _readyFrame>=0 ) { _shownFrame = _readyFrame; _readyFrame = -1; }
+		// The ready frame was just taken, so any frame but the shown one is free
+		if( !_inFlight ) slot = (_shownFrame+1)%3;
+	}
+	glClearColor(_clearColor.r,_clearColor.b,_clearColor.g,_clearColor.a);
+	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+	if( _shownFrame>=0 ) blitFrame( _frames[_shownFrame] );
+	if( slot<0 ) return;
+
+	// Start a frame only when what it would show has changed
+	camera().viewport(size());
+	auto differ = [](const mat4& a, const mat4& b) { return memcmp( &a, &b, sizeof(mat4) )!=0; };
+	bool changed = differ( camera().viewMat(), _lastView ) || differ( camera().projMat(), _lastProj )
+		|| vp[2]!=_lastW || vp[3]!=_lastH || _shownFrame<0
+		|| _renderer->sceneVersion()!=_lastVersion || _renderer->staticSceneVersion()!=_lastStaticVersion
+		|| _renderer->pendingWork();
+	if( !changed ) return;
+	_lastView = camera().viewMat();
+	_lastProj = camera().projMat();
+	_lastW = vp[2];
+	_lastH = vp[3];
+	_lastVersion = _renderer->sceneVersion();
+	_lastStaticVersion = _renderer->staticSceneVersion();
+
+	_snapshotFunc();
+	_renderCamera.sceneCenter( camera().sceneCenter(), true );
+	_renderCamera.cameraPos( camera().cameraPos(), true );
+	_renderCamera.viewMat( camera().viewMat() );
+	_renderCamera.projMat( camera().projMat() );
+	_inFlight = true;
+	std::shared_ptr<JR::Renderer> renderer = _renderer;
+	_AsyncFrame* f = &_frames[slot];
+	sz2_t sz = size();
+	int w = vp[2], h = vp[3];
+	colora_t clear = _clearColor;
+	_JGL::renderThread().post( [this,renderer,f,slot,sz,w,h,clear]() {
+		if( f->read ) { glWaitSync( f->read, 0, GL_TIMEOUT_IGNORED ); glDeleteSync( f->read ); f->read = nullptr; }
+		f->target.create( w, h );
+		f->target.setToTarget();
+		glClearColor(clear.r,clear.b,clear.g,clear.a);
+		glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+		renderer->render( sz, _renderCamera );
+		f->target.restoreVP();
+		if( f->written ) glDeleteSync( f->written );
+		f->written = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		f->w = w;
+		f->h = h;
+		glFlush();
+		{
+			std::unique_lock<std::mutex> lock(_frameMutex);
+			_readyFrame = slot;
+			_inFlight = false;
+		}
+		_JGL::runOnUIThread( [self=std::weak_ptr<View3D*>(_self)](void*){ if( auto s = self.lock() ) (*s)->redraw(); } );
+	} );
+}
+
+inline void View3D::blitFrame(_AsyncFrame& f) {
+	if( f.written ) {
+		glWaitSync( f.written, 0, GL_TIMEOUT_IGNORED );
+		glDeleteSync( f.written );
+		f.written = nullptr;
+	}
+	// Framebuffer objects are not shared between contexts; wrap the texture on this one
+	if( f.readTex != f.target.colorTex() ) {
+		if( !f.readFBO ) glGenFramebuffers( 1, &f.readFBO );
+		GLint oldRead;
+		glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &oldRead );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, f.readFBO );
+		glFramebufferTexture( GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, f.target.colorTex(), 0 );
+		glFramebufferTexture( GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, f.target.depthTex(), 0 );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, oldRead );
+		f.readTex = f.target.colorTex();
+	}
+	GLint vp[4], oldRead;
+	glGetIntegerv( GL_VIEWPORT, vp );
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &oldRead );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, f.readFBO );
+	glBlitFramebuffer( 0, 0, f.w, f.h, vp[0], vp[1], vp[0]+vp[2], vp[1]+vp[3], GL_COLOR_BUFFER_BIT, GL_LINEAR );
+	std::copy( vp, vp+4, _shownVP );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, oldRead );
+	if( f.read ) glDeleteSync( f.read );
+	f.read = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+}
+
+// Waits for the frame in flight and frees the render thread's resources for this view
+inline void View3D::releaseThreaded() {
+	if( !_threaded ) return;
+	if( !_JGL::hasRenderThread() ) {
+		// Never started, or torn down with the GL contexts after run(); nothing left to free
+		for( auto& f: _frames ) f = _AsyncFrame();
+		_shownFrame = _readyFrame = -1;
+		_inFlight = false;
+		return;
+	}
+	std::shared_ptr<JR::Renderer> renderer = _renderer;
+	_JGL::renderThread().post( [this,renderer]() {
+		if( renderer ) renderer->releaseView( &_renderCamera );
+		for( auto& f: _frames ) {
+			f.target.clearGL();
+			if( f.written ) glDeleteSync( f.written );
+			f.written = nullptr;
+		}
+	} );
+	_JGL::renderThread().wait();
+	for( auto& f: _frames ) {
+		if( f.read ) glDeleteSync( f.read );
+		if( f.readFBO ) glDeleteFramebuffers( 1, &f.readFBO );
+		f = _AsyncFrame();
+	}
+	_shownFrame = _readyFrame = -1;
+	_inFlight = false;
+}
+
+// Only color is blitted while threaded; read the depth of the shown frame itself
+inline float View3D::readDepth(const pos_t& pt) {
+	if( !_threaded || _shownFrame<0 || !_frames[_shownFrame].readFBO ) return _Picker3D::readDepth(pt);
+	const _AsyncFrame& f = _frames[_shownFrame];
+	int x = int( floor( (pt.x-_shownVP[0])*f.w/std::max(_shownVP[2],1) ) );
+	int y = int( floor( (pt.y-_shownVP[1])*f.h/std::max(_shownVP[3],1) ) );
+	if( x<0 || y<0 || x>=f.w || y>=f.h ) return 1;
+	float d = 1;
+	GLint oldRead;
+	glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &oldRead );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, f.readFBO );
+	glReadPixels( x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &d );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, oldRead );
+	return d;
+}
+
+inline void View3D::drawContents(NVGcontext* vg, const rct_t& r, align_t a ) {
+	// The render thread writes the timer while threaded
+	JR::PassTimer* timer = _showPassTimes&&_renderer&&!_threaded ? _renderer->passTimer() : nullptr;
+	if( !timer ) return;
+	const auto& times = timer->times();
+	float pt = _pt_tooltip_text(), lh = pt*1.2f, total = 0;
+	for( auto& p: times ) if( p.depth==0 ) total += p.ms;
+	rct_t box( r.x+4, r.y+4, pt*10, lh*(times.size()+1)+4 );
+	nvgBeginPath( vg );
+	nvgRect( vg, box.x, box.y, box.w, box.h );
+	nvgFillColor( vg, nvgRGBAf(0,0,0,.5f) );
+	nvgFill( vg );
+	nvgFontFace( vg, _font_tooltip_text() );
+	nvgFontSize( vg, pt );
+	nvgFillColor( vg, nvgRGBAf(1,1,1,.9f) );
+	char buf[64];
+	float y = box.y+2;
+	for( auto& p: times ) {
+		snprintf( buf, sizeof(buf), "%.2f ms", p.ms );
+		nvgTextAligned( vg, rct_t(box.x+4+p.depth*pt, y, box.w-8, lh), p.name, NVG_ALIGN_LEFT|NVG_ALIGN_MIDDLE );
+		nvgTextAligned( vg, rct_t(box.x+4, y, box.w-8, lh), buf, NVG_ALIGN_RIGHT|NVG_ALIGN_MIDDLE );
+		y += lh;
+	}
+	snprintf( buf, sizeof(buf), "%.2f ms", total );
+	nvgTextAligned( vg, rct_t(box.x+4, y, box.w-8, lh), "GPU", NVG_ALIGN_LEFT|NVG_ALIGN_MIDDLE );
+	nvgTextAligned( vg, rct_t(box.x+4, y, box.w-8, lh), buf, NVG_ALIGN_RIGHT|NVG_ALIGN_MIDDLE );
+	// Results arrive frames later: one more redraw shows this frame's, after which the
+	// overlay rests until something else redraws the view
+	if( timer->pending() && !_passTimesRefresh ) {
+		_passTimesRefresh = true;
+		scheduleRedraw( .1 );
+	}
+	else _passTimesRefresh = false;
+}
+
 inline bool View3D::handle( event_t e ) {
 	mat4 vp = projMat()*viewMat();
 	bool ret = false;
@@ -119,8 +391,10 @@ inline bool View3D::handle( event_t e ) {
 				redraw();
 				ret = true;
 			}
-			else
-				ret = _Picker3D::handle(e,size(),vp,float(getWindowSize().h));
+			else if( _Picker3D::handle(e,size(),vp,float(getWindowSize().h)) ) {
+				_renderer->sceneChanged();
+				ret = true;
+			}
 			break;
 		case event_t::ZOOM:
 			camera().zoom(_JGL::eventZoom(), _JGL::eventMods(mod_t::CONTROL));
@@ -161,6 +435,7 @@ struct Render3DView : View3D {
 };
 
 using PBRRenderView = Render3DView<JR::PBRRenderer>;
+using DeferredRenderView = Render3DView<JR::DeferredRenderer>;
 
 } // namespace JGL
 
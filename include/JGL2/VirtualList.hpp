@@ -0,0 +1,238 @@
+//
+//  VirtualList.hpp
+//  JGL2
+//
+
+#ifndef JGL2_VirtualList_hpp
+#define JGL2_VirtualList_hpp
+
+#ifdef __APPLE__
+#pragma clang visibility push(default)
+#pragma clang diagnostic ignored "-Wdocumentation"
+#endif
+
+#include <vector>
+#include <cmath>
+#include <functional>
+
+#include <JGL2/Group.hpp>
+
+namespace JGL2 {
+
+typedef std::function<Widget*()>				ItemCreateCallback_t;
+typedef std::function<void(Widget*,size_t)>		ItemBindCallback_t;
+
+// A scrolling list (or grid, with columns>1) of count() equally sized items, where
+// only the visible rows plus overscan() rows above and below have widgets. The
+// widgets are made by the create callback and recycled as the list scrolls: item i
+// always lives in slot i%poolSize, so a scroll re-binds only the items that came
+// into view, and the cost does not depend on count().
+struct VirtualList : public Group {
+	VirtualList(float x, float y, float w, float h, const str_t& label="List" );
+	VirtualList(const pos_t& pos, const sz2_t& sz, const str_t& label="List" );
+
+	virtual void		dataSource(size_t count, ItemCreateCallback_t create, ItemBindCallback_t bind);
+	virtual void		count(size_t n);
+	virtual size_t		count() const { return _count; }
+	virtual void		rowHeight(float h);
+	virtual float		rowHeight() const { return _rowHeight; }
+	virtual void		columns(size_t n);
+	virtual size_t		columns() const { return _columns; }
+	virtual void		overscan(size_t rows);
+	virtual size_t		overscan() const { return _overscan; }
+
+	// Re-binds the visible items, after the data behind them changed
+	virtual void		reload();
+	virtual void		scrollToItem(size_t i);
+	// The widget showing item i, or nullptr when it is out of view
+	virtual Widget*		itemWidget(size_t i) const;
+	virtual idx_t		itemIndex(const Widget* w) const;
+
+	virtual void		scrollOffset(const pos_t& d) override;
+	virtual pos_t		scrollOffset() const override { return Group::scrollOffset(); }
+	virtual bool		scrollHandle(event_t event) override;
+
+protected:
+	static constexpr size_t NO_ITEM = size_t(-1);
+
+	virtual void		updateContentsRect(NVGcontext* vg) override;
+	virtual void		rearrange(NVGcontext* vg, autoscale_t scaling) override;
+	virtual void		updateVisibleItems();
+	inline size_t		rowCount() const { return (_count+_columns-1)/_columns; }
+	inline size_t		poolSize() const;
+
+	ItemCreateCallback_t	_create;
+	ItemBindCallback_t		_bind;
+	size_t					_count		= 0;
+	float					_rowHeight	= 24;
+	size_t					_columns	= 1;
+	size_t					_overscan	= 2;
+	// Item bound to each slot widget (same order as _children)
+	std::vector<size_t>		_slotItem;
+	float					_boundWidth	= -1;
+};
+
+inline VirtualList::VirtualList(float x, float y, float w, float h, const str_t& label )
+: Group( x, y, w, h, label ) {
+	alignment( align_t::LEFT|align_t::TOP );
+	// Items come from the data source only
+	end();
+}
+
+inline VirtualList::VirtualList(const pos_t& pos, const sz2_t& sz, const str_t& label )
+: Group( pos, sz, label ) {
+	alignment( align_t::LEFT|align_t::TOP );
+	end();
+}
+
+inline void VirtualList::dataSource(size_t n, ItemCreateCallback_t create, ItemBindCallback_t bind) {
+	_create = create;
+	_bind = bind;
+	clear( true );
+	_slotItem.clear();
+	_count = n;
+	change();
+}
+
+inline void VirtualList::count(size_t n) {
+	if( _count==n ) return;
+	_count = n;
+	// Slots past the new end are hidden, the rest keep their items
+	change();
+}
+
+inline void VirtualList::rowHeight(float h) {
+	_rowHeight = std::max(1.f,h);
+	change();
+}
+
+inline void VirtualList::columns(size_t n) {
+	_columns = std::max(n,size_t(1));
+	reload();
+}
+
+inline void VirtualList::overscan(size_t rows) {
+	_overscan = rows;
+	change();
+}
+
+inline void VirtualList::reload() {
+	std::fill( _slotItem.begin(), _slotItem.end(), NO_ITEM );
+	change();
+}
+
+inline void VirtualList::scrollToItem(size_t i) {
+	if( i>=_count ) return;
+	float top = topPadding()+(i/_columns)*_rowHeight;
+	float off = _scrollOffset.y;
+	if( top<off ) off = top;
+	else if( top+_rowHeight>off+h() ) off = top+_rowHeight-h();
+	scrollOffset( pos_t(_scrollOffset.x,off) );
+}
+
+inline Widget* VirtualList::itemWidget(size_t i) const {
+	if( _slotItem.empty() || i>=_count ) return nullptr;
+	size_t s = i%_slotItem.size();
+	if( s>=children() || _slotItem[s]!=i || child(int(s))->hidden() ) return nullptr;
+	return child(int(s));
+}
+
+inline idx_t VirtualList::itemIndex(const Widget* w) const {
+	for( size_t s=0; s<children() && s<_slotItem.size(); s++ )
+		if( child(int(s))==w && !w->hidden() && _slotItem[s]<_count ) return idx_t(_slotItem[s]);
+	return -1;
+}
+
+inline void VirtualList::scrollOffset(const pos_t& d) {
+	float old = _scrollOffset.y;
+	Group::scrollOffset(d);
+	if( old!=_scrollOffset.y ) {
+		updateVisibleItems();
+		damage();
+	}
+}
+
+inline bool VirtualList::scrollHandle(event_t event) {
+	float old = _scrollOffset.y;
+	bool ret = Group::scrollHandle(event);
+	if( old!=_scrollOffset.y )
+		updateVisibleItems();
+	return ret;
+}
+
+inline size_t VirtualList::poolSize() const {
+	size_t rows = size_t(std::ceil(h()/_rowHeight))+1+_overscan*2;
+	return std::min( rows*_columns, _count );
+}
+
+inline void VirtualList::updateVisibleItems() {
+	size_t n = poolSize();
+	if( n<1 ) {
+		for( size_t s=0; s<children(); s++ ) if( !child(int(s))->hidden() ) child(int(s))->hide();
+		return;
+	}
+	float cellW = (w()-horzPadding())/_columns;
+	if( n!=_slotItem.size() || cellW!=_boundWidth ) {
+		// The item-to-slot mapping changed; every slot gets re-bound
+		_slotItem.assign( n, NO_ITEM );
+		_boundWidth = cellW;
+	}
+	if( children()<n && _create ) {
+		// Rows made by the callback land in this group, not the one being built elsewhere
+		_JGL::pushAddingGroup( this );
+		while( children()<n ) {
+			Widget* c = _create();
+			if( !c ) break;
+			add( c );
+		}
+		_JGL::popAddingGroupUntil( this );
+	}
+
+	// Visible rows, from the offset clamped the way scrollRange() will clamp it
+	float viewH = h();
+	float maxOff = std::max(0.f, topPadding()+rowCount()*_rowHeight+bottomPadding()-viewH);
+	float off = std::max(0.f, std::min(_scrollOffset.y, maxOff))-topPadding();
+	size_t firstRow = size_t(std::max(0.f, std::floor(off/_rowHeight)));
+	firstRow = firstRow>_overscan ? firstRow-_overscan : 0;
+	size_t begin = std::min( firstRow*_columns, _count );
+	size_t end = std::min( begin+n, _count );
+
+	for( size_t s=0; s<children(); s++ ) {
+		Widget* c = child(int(s));
+		size_t i = begin+(s+n-begin%n)%n;
+		if( s>=n || i>=end ) {
+			// Most of these were hidden by an earlier scroll already
+			if( !c->hidden() ) c->hide();
+			continue;
+		}
+		if( _slotItem[s]!=i ) {
+			_slotItem[s] = i;
+			if( _bind ) _bind( c, i );
+			c->change();
+		}
+		c->resize( pos_t( leftPadding()+(i%_columns)*cellW, topPadding()+(i/_columns)*_rowHeight ),
+				   sz2_t( cellW, _rowHeight ) );
+		c->show();
+	}
+}
+
+inline void VirtualList::updateContentsRect(NVGcontext*) {
+	_contentsRect = rct_t( 0, 0, w(), rowCount()*_rowHeight+vertPadding() );
+}
+
+inline void VirtualList::rearrange(NVGcontext* vg, autoscale_t scaling) {
+	if( changed() ) {
+		Widget::rearrange( vg, scaling );
+		updateVisibleItems();
+	}
+	// Only the rows just bound or moved are reformed
+	reformChangedChildren( vg );
+}
+
+} // namespace JGL2
+
+#ifdef __APPLE__
+#pragma clang visibility pop
+#endif
+
+#endif /* JGL2_VirtualList_hpp */
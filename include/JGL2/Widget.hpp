@@ -136,8 +136,14 @@ struct Widget {
 // calling animate() will notify the window so it should be animated
 	virtual void		animate();
 	virtual void		change();
+// Called on the parent when something below it changed
+	virtual void		childChanged() {}
 	virtual void		damage();
 	virtual void		redraw() { damage(); }
+// Marks r (in this widget's coordinates) for redraw; damage() and animate() pass the whole widget
+	virtual void		invalidate(const rct_t& r, bool animating);
+// False when the window is redrawing only a part that does not touch this widget
+	virtual bool		inRedrawRect() const;
 
 	virtual void		callback( Callback_t callback, void* userdata=nullptr );
 	virtual void		dndCallback( DNDCallback_t cb, void* ud=nullptr );
@@ -192,6 +198,10 @@ struct Widget {
 	virtual DNDCallback_t	dndCallback() const { return _dndCallback; }
 	virtual void*		dndUserdata() const { return _dndUserdata; }
 	virtual Widget*		parent() const { return _parent; }
+// Set by the Group and Window constructors, so traversal does not need dynamic_cast
+	inline Group*		groupPtr() const { return _groupPtr; }
+	inline _Scrollable*	scrollablePtr() const { return _scrollablePtr; }
+	inline Window*		windowPtr() const { return _windowPtr; }
 
 
 // Those function is used by the enclouser and the JGL
@@ -366,6 +376,9 @@ protected:
 	
 // Hierarchial model system
 	Widget*						_parent				= nullptr;
+	Group*						_groupPtr			= nullptr;
+	_Scrollable*				_scrollablePtr		= nullptr;
+	Window*						_windowPtr			= nullptr;
 
 	irct_t						_prevViewport;
 	irct_t						_prevScrissor;
@@ -560,7 +573,10 @@ inline void Widget::fillImage() {
 
 inline void Widget::position(const pos_t& p) {
 	if( position().x!=p.x || position().y!=p.y ) {
+		// Both where it was and where it lands are redrawn
+		Widget::invalidate( rct_t(0,0,_bound.w,_bound.h), false );
 		_bound.tl() = p;
+		Widget::invalidate( rct_t(0,0,_bound.w,_bound.h), false );
 		if( parent() ) parent()->change();
 	}
 }
@@ -620,17 +636,31 @@ inline void Widget::show() {
 }
 
 inline void Widget::animate() {
-	if( parent() )
-		parent()->animate();
+	invalidate( rct_t(0,0,w(),h()), true );
 }
 
 inline void Widget::change() {
 	_changed = true;
+	if( parent() )
+		parent()->childChanged();
 }
 
 inline void Widget::damage() {
-	if( parent() )
-		parent()->damage();
+	invalidate( rct_t(0,0,w(),h()), false );
+}
+
+inline void Widget::invalidate(const rct_t& r, bool animating) {
+	if( !parent() ) return;
+	pos_t p = position();
+	_Scrollable* scroller = parent()->scrollablePtr();
+	if( scroller )
+		p = p-scroller->scrollOffset();
+	parent()->invalidate( rct_t( r.x+p.x, r.y+p.y, r.w, r.h ), animating );
+}
+
+inline bool Widget::inRedrawRect() const {
+	rct_t r = _JGL::getCurrentDrawWindowRedrawRect();
+	return r.w<0 || overlaps( abs_rect(), r );
 }
 
 inline void Widget::callback( Callback_t callback, void* userdata ) {
@@ -644,16 +674,18 @@ inline void Widget::dndCallback( DNDCallback_t cb, void* ud ) {
 
 inline void Widget::parent( Widget* w ) {
 	if( parent() && parent()!=w ) {
-		Group* g = dynamic_cast<Group*>(parent());
+		Group* g = parent()->groupPtr();
 		if( g )
 			g->remove( this );
 	}
 	_parent = w;
+	if( _parent && changed() )
+		_parent->childChanged();
 }
 
 inline Window* Widget::window() {
-	if( dynamic_cast<Window*>(this) )
-		return dynamic_cast<Window*>(this);
+	if( _windowPtr )
+		return _windowPtr;
 	else if( parent() )
 		return parent()->window();
 	return nullptr;
@@ -669,7 +701,7 @@ inline bool Widget::under() const {
 
 inline pos_t Widget::abs_pos() const {
 	if( parent() ) {
-		_Scrollable* scroller = dynamic_cast<_Scrollable*>(parent());
+		_Scrollable* scroller = parent()->scrollablePtr();
 		if( scroller )
 			return parent()->abs_pos()-scroller->scrollOffset()+position();
 		else
@@ -800,8 +832,18 @@ inline void Widget::setViewport() const {
 	int ww = int(ceil(w()*pxRatio*uiRatio));
 	int hh = int(ceil(h()*pxRatio*uiRatio));
 	
-	glEnable( GL_SCISSOR_TEST );
 	glViewport( xx, yy, ww, hh );
+	// Stay inside the window's redraw region
+	if( glIsEnabled( GL_SCISSOR_TEST ) ) {
+		GLint sc[4];
+		glGetIntegerv( GL_SCISSOR_BOX, sc );
+		int x1 = std::min( xx+ww, sc[0]+sc[2] ), y1 = std::min( yy+hh, sc[1]+sc[3] );
+		xx = std::max( xx, sc[0] );
+		yy = std::max( yy, sc[1] );
+		ww = std::max( x1-xx, 0 );
+		hh = std::max( y1-yy, 0 );
+	}
+	glEnable( GL_SCISSOR_TEST );
 	glScissor ( xx, yy, ww, hh );
 }
 	
@@ -818,7 +860,7 @@ inline void Widget::draw(NVGcontext* vg) {
 	rct_t r(0,0,w(),h());
 	drawBox(vg,r);
 	nvgSave(vg);
-	_Scrollable* sc = dynamic_cast<_Scrollable*>(this);
+	_Scrollable* sc = scrollablePtr();
 	if( sc )
 		nvgTranslate(vg, -sc->scrollOffset().x, -sc->scrollOffset().y );
 	drawContents(vg,r,alignment());
@@ -874,9 +916,13 @@ inline void Widget::drawContents(NVGcontext* vg, const rct_t& r, align_t a ) {
 }
 
 inline void Widget::reform(NVGcontext* vg, autoscale_t scaling) {
+	sz2_t oldSize = _bound.wh();
 	rearrange(vg, scaling);
 	_changed = false;
-	_Scrollable* sc = dynamic_cast<_Scrollable*>(this);
+	// A new size covers or uncovers part of the parent; redraw the larger of the two
+	if( _bound.wh()!=oldSize )
+		Widget::invalidate( rct_t(0,0,std::max(oldSize.w,_bound.w),std::max(oldSize.h,_bound.h)), false );
+	_Scrollable* sc = scrollablePtr();
 	if( sc )
 		sc->scrollRange(bound().wh(), contentsRect(), alignment() );
 }
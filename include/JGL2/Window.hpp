@@ -44,6 +44,10 @@ struct Window : public Group, public _PopupHandler {
 	Window( float width, float height, const str_t& title );
 	Window( const sz2_t& sz, const str_t& title );
 	virtual void		enableHDR();
+	// Multisampling of the window's framebuffer, requested when the window is first
+	// shown; reads back what the context actually got afterwards
+	virtual void		samples(int n) { _samples = n; }
+	virtual int			samples() const { return _samples; }
 	virtual color_t		windowGamma() const;
 	virtual colorMat_t	windowColorMat() const;
 
@@ -51,8 +55,7 @@ struct Window : public Group, public _PopupHandler {
 	virtual void		hide() override;
 	virtual void		close();
 	virtual void		label( const str_t& l ) override;
-	virtual void		damage() override { _damaged = true; }
-	virtual void		animate() override { _animated = true; }
+	virtual void		invalidate(const rct_t& r, bool animating) override;
 	virtual void		clearDamaged() { _damaged = false; }
 	virtual void		clearAnimated() { _animated = false; }
 
@@ -86,17 +89,33 @@ struct Window : public Group, public _PopupHandler {
 	virtual Widget* 	targetWidget() const;
 	virtual void		uiRatio(float ratio, bool changePhysicalWindowSize=false);
 
+	// Redraws only the union of the damaged rects; the rest is kept in an offscreen copy.
+	// Off by default. The copy is single-sampled RGBA8, so it is not used for HDR or
+	// multisampled windows (set samples(0) before show())
+	virtual void		partialRedraw(bool b) { _partialRedraw = b; damage(); }
+	virtual bool		partialRedraw() const { return _partialRedraw; }
+	// Part of the window being drawn now, w<0 when it is the whole window
+	virtual const rct_t& redrawRect() const { return _redrawRect; }
+	// Framebuffer holding the last frame's drawing and depth (the offscreen copy in
+	// partial mode), for reading back between frames
+	virtual GLuint		drawFramebuffer() const { return _drawFramebuffer; }
+
 protected:
 	
 	virtual void		destory();
 	virtual void		updateUnderWidget(const pos_t& pt,float timestamp);
 	virtual void		dismissTooltip();
 	virtual void		startTooltip();
+	virtual rct_t		tooltipRect() const;
 	virtual bool		handle(event_t event) override;
 
 	
 	virtual void		draw(NVGcontext* vg) override;
-	virtual void		render();
+	// Waits until fewer than framesInFlight earlier frames are still on the GPU, then draws and swaps
+	virtual void		render( int framesInFlight=2, bool vsync=true );
+	virtual void		waitFrameFence( int framesInFlight );
+	virtual void		pushFrameFence();
+	virtual void		clearFrameFences();
 	virtual void		isFocused(bool a) { _isFocused = a; }
 	
 	bool				_enableHDR		= false;
@@ -114,6 +133,15 @@ protected:
 	NVGcontext*			_vg				= nullptr;
 	float				_pxRatio		= 1.f;
 	float				_uiRatio		= 1.f;
+	float				_textScale		= 0.f;
+
+	int					_samples		= 4;
+	bool				_partialRedraw	= false;
+	GLuint				_drawFramebuffer = 0;
+	rct_t				_dirtyRect		= rct_t(0,0,0,0);
+	rct_t				_redrawRect		= rct_t(0,0,-1,-1);
+	bool				_hadPopup		= false;
+	std::shared_ptr<_DrawCache>	_backbuffer;
 		
 	Widget*				_currentTarget	= nullptr;
 	
@@ -124,8 +152,14 @@ protected:
 	float				_tooltipAlpha	= 0.f;
 	const Widget*		_underWidget	= nullptr;
 	float				_underWidgetChangedTimestamp = 0;
+	size_t				_tooltipTimer	= 0;
 	
 	sz2_t				_lastRenderSz   = sz2_t(0,0);
+	
+	static constexpr int MAX_FRAMES_IN_FLIGHT = 3;
+	GLsync				_frameFences[MAX_FRAMES_IN_FLIGHT] = {};
+	size_t				_frameCount		= 0;
+	int					_swapInterval	= 1;
 	friend _JGL;
 	
 	static void			nvgRegisterDefaultFonts( NVGcontext* vg, const str_t& path );
@@ -148,6 +182,7 @@ inline void	_Popup::dismiss() {
 } // namespace JGL2
 
 #include "_Draw.hpp"
+#include "_DrawCache.hpp"
 #include "PopupBox.hpp"
 
 namespace JGL2 {
@@ -169,7 +204,7 @@ inline Widget* findFirstTargettable( const Group* g, int start=0 ) {
 		Widget* c = g->child(i);
 		_Targettable* t = dynamic_cast<_Targettable*>(c);
 		if( t && t->targettable() && c->active() && t->navigatable() ) return c;
-		Group* gg = dynamic_cast<Group*>(c);
+		Group* gg = c->groupPtr();
 		if( gg ) {
 			Widget* ret = findFirstTargettable( gg );
 			if( ret ) return ret;
@@ -179,7 +214,7 @@ inline Widget* findFirstTargettable( const Group* g, int start=0 ) {
 }
 
 inline Widget* findNextTargettable( Widget* w) {
-	Group* prnt = dynamic_cast<Group*>(w->parent());
+	Group* prnt = w->parent()?w->parent()->groupPtr():nullptr;
 	if( !prnt ) return nullptr;
 	idx_t idx = findWidgetIndex( prnt, w );
 	if( idx<0 ) return nullptr;
@@ -188,7 +223,7 @@ inline Widget* findNextTargettable( Widget* w) {
 		Widget* t = findFirstTargettable( prnt, idx+1 );
 		if( t ) return t;
 		Widget* oldP = prnt;
-		prnt = dynamic_cast<Group*>(prnt->parent());
+		prnt = prnt->parent()?prnt->parent()->groupPtr():nullptr;
 		if( !prnt ) return nullptr;
 		idx = findWidgetIndex( prnt, oldP );
 	}
@@ -200,7 +235,7 @@ inline Widget* findLastTargettable( const Group* g, int start=1000000000 ) {
 		Widget* c = g->child(i);
 		_Targettable* t = dynamic_cast<_Targettable*>(c);
 		if( t && t->targettable() && c->active() && t->navigatable() ) return c;
-		Group* gg = dynamic_cast<Group*>(c);
+		Group* gg = c->groupPtr();
 		if( gg ) {
 			Widget* ret = findLastTargettable( gg );
 			if( ret ) return ret;
@@ -210,7 +245,7 @@ inline Widget* findLastTargettable( const Group* g, int start=1000000000 ) {
 }
 
 inline Widget* findPrevTargettable( Widget* w) {
-	Group* prnt = dynamic_cast<Group*>(w->parent());
+	Group* prnt = w->parent()?w->parent()->groupPtr():nullptr;
 	if( !prnt ) return nullptr;
 	idx_t idx = findWidgetIndex( prnt, w );
 	if( idx<0 ) return nullptr;
@@ -219,7 +254,7 @@ inline Widget* findPrevTargettable( Widget* w) {
 		Widget* t = findLastTargettable( prnt, idx-1 );
 		if( t ) return t;
 		Widget* oldP = prnt;
-		prnt = dynamic_cast<Group*>(prnt->parent());
+		prnt = prnt->parent()?prnt->parent()->groupPtr():nullptr;
 		if( !prnt ) return nullptr;
 		idx = findWidgetIndex( prnt, oldP );
 	}
@@ -228,11 +263,13 @@ inline Widget* findPrevTargettable( Widget* w) {
 
 inline Window::Window( float width, float height, const str_t& title )
 : Group( 0, 0, width, height, title ){
+	_windowPtr = this;
 	_JGL::registerWindow( this );
 }
 
 inline Window::Window( const sz2_t& sz, const str_t& title )
 : Group( pos_t(0,0), sz, title ){
+	_windowPtr = this;
 	_JGL::registerWindow( this );
 }
 
@@ -275,7 +312,7 @@ inline void Window::show() {
 			glfwWindowHint(GLFW_GREEN_BITS, 16);
 			glfwWindowHint(GLFW_BLUE_BITS, 16);
 		}
-		glfwWindowHint(GLFW_SAMPLES, 4);
+		glfwWindowHint(GLFW_SAMPLES, _samples);
 
 		_bound.wh() = _setSize;
 		_bound.tl() = pos_t(0,0);
@@ -297,6 +334,7 @@ inline void Window::show() {
 		glewInit();
 		glEnable(GL_FRAMEBUFFER_SRGB);
 #endif
+		glGetIntegerv(GL_SAMPLES, &_samples);
 
 #ifdef GL2
 		_vg = nvgCreateGL2(NVG_ANTIALIAS|NVG_STENCIL_STROKES | NVG_DEBUG);
@@ -314,6 +352,7 @@ inline void Window::show() {
 		glfwFocusWindow(_glfwWindow);
 		_JGL::windowFocusCallback( _glfwWindow, GLFW_FOCUSED );
 		glfwSwapInterval(1);
+		_swapInterval = 1;
 	}
 	else if( _hidden ) {
 		glfwShowWindow(_glfwWindow);
@@ -329,6 +368,9 @@ inline void Window::close() {
 inline void Window::destory() {
 	_destroyed = true;
 	glfwMakeContextCurrent(_glfwWindow);
+	clearFrameFences();
+	_backbuffer = nullptr;
+	_JGL::releaseContext( _glfwWindow );
 	glfwDestroyWindow( _glfwWindow );
 	glfwPollEvents();
 	_glfwWindow = nullptr;
@@ -347,7 +389,30 @@ inline colora_t windowColor( Widget* widget, const NVGcolor& c ) {
 
 
 
-inline void Window::render() {
+inline void Window::waitFrameFence( int framesInFlight ) {
+	if( _frameCount < size_t(framesInFlight) ) return;
+	GLsync fence = _frameFences[(_frameCount-framesInFlight)%MAX_FRAMES_IN_FLIGHT];
+	if( !fence ) return;
+	JGL2_PROFILE_ZONE("waitFrameFence");
+	while( glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000 ) == GL_TIMEOUT_EXPIRED );
+}
+
+inline void Window::pushFrameFence() {
+	GLsync& fence = _frameFences[_frameCount%MAX_FRAMES_IN_FLIGHT];
+	if( fence ) glDeleteSync( fence );
+	fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	_frameCount++;
+}
+
+inline void Window::clearFrameFences() {
+	for( auto& f: _frameFences ) {
+		if( f ) glDeleteSync( f );
+		f = nullptr;
+	}
+	_frameCount = 0;
+}
+
+inline void Window::render( int framesInFlight, bool vsync ) {
 	_windowColorMat = colorMat_t(1);
 	_windowGamma = color_t(2.4f);
 #ifdef _WIN32
@@ -356,21 +421,66 @@ inline void Window::render() {
 		_windowColorMat = colorMat_t(_windowsHDRGain);
 #endif
 	glfwMakeContextCurrent( _glfwWindow );
+	waitFrameFence( std::min( std::max( framesInFlight, 1 ), MAX_FRAMES_IN_FLIGHT ) );
+	if( _swapInterval != int(vsync) ) {
+		_swapInterval = int(vsync);
+		glfwSwapInterval( _swapInterval );
+	}
 	_JGL::setCurrentDrawWindow( this );
 	colora_t clearColor = windowColor(this,_color_panel());
 	glClearColor( clearColor.r, clearColor.g, clearColor.b, clearColor.a );
-	glClear(GL_DEPTH_BUFFER_BIT|GL_COLOR_BUFFER_BIT);
 	int fbw, fbh, ww, wh;
 	glfwGetFramebufferSize( _glfwWindow, &fbw, &fbh );
 	glfwGetWindowSize( _glfwWindow, &ww, &wh );
 	_pxRatio = round(fbw/float(ww));
+	float scale = _pxRatio*_uiRatio;
+	// nanovg measures text at the device scale
+	if( scale!=_textScale ) {
+		TextLayoutCache::get().clear( _vg );
+		_textScale = scale;
+	}
+
+	// Draw into the persistent copy, redrawing only the dirty part when it is still valid
+	rct_t dirty = _dirtyRect;
+	_dirtyRect = rct_t(0,0,0,0);
+	if( _tooltipEngaged || _tooltipAlpha>0.f )
+		dirty = dirty.w>0 ? rct_t(dirty).increase( tooltipRect() ) : tooltipRect();
+	bool partial = false;
+	GLuint target = 0;
+	if( _partialRedraw && _samples<=1 && !_enableHDR ) {
+		if( !_backbuffer ) _backbuffer = std::make_shared<_DrawCache>();
+		bool fresh = !_backbuffer->valid() || _backbuffer->w!=fbw || _backbuffer->h!=fbh;
+		if( _backbuffer->create( _vg, fbw, fbh ) ) {
+			target = _backbuffer->fbo;
+			partial = !fresh && !hasPopup() && !_hadPopup;
+		}
+	}
+	_hadPopup = hasPopup();
+	_drawFramebuffer = target;
+	glBindFramebuffer( GL_FRAMEBUFFER, target );
 	glViewport( 0, 0, fbw, fbh );
+	if( partial ) dirty = intersection( dirty, rct_t(0,0,w(),h()) );
+	// The GL scissor clips the clear and, since glnvg keeps it, the nanovg frames
+	auto clipToDirty = [&]() {
+		if( partial ) {
+			int x0 = int(floor(dirty.x*scale)), x1 = int(ceil((dirty.x+dirty.w)*scale));
+			int y0 = int(floor(dirty.y*scale)), y1 = int(ceil((dirty.y+dirty.h)*scale));
+			glEnable( GL_SCISSOR_TEST );
+			glScissor( x0, fbh-y1, x1-x0, y1-y0 );
+		}
+		else
+			glDisable( GL_SCISSOR_TEST );
+	};
+	clipToDirty();
+	glClear(GL_DEPTH_BUFFER_BIT|GL_COLOR_BUFFER_BIT|GL_STENCIL_BUFFER_BIT);
+	_redrawRect = partial ? dirty : rct_t(0,0,-1,-1);
 
 	clearDamaged();
 #ifdef _WIN32
 		nvgBeginFrame( _vg, ww/_uiRatio, wh/_uiRatio, _pxRatio*_uiRatio );
 		nvgOutputGamma(_vg,value_ptr(_windowGamma));
 		nvgOutputColorMat(_vg,value_ptr(_windowColorMat));
+		if( partial ) nvgScissor( _vg, dirty.x, dirty.y, dirty.w, dirty.h );
 		nvgBeginPath(_vg);
 		nvgRect(_vg,0.f,0.f,float(ww),float(wh));
 		nvgFillColor(_vg,_color_panel());
@@ -378,16 +488,26 @@ inline void Window::render() {
 		nvgEndFrame(_vg);
 #endif
 	recursiveDrawGL();
-
+	// Cached subtrees are drawn whole
+	_redrawRect = rct_t(0,0,-1,-1);
+	updateDrawCaches( _vg, scale );
+	_redrawRect = partial ? dirty : rct_t(0,0,-1,-1);
+
+	JGL2_PROFILE_ZONE("nanovg");
+	// GL widgets and the caches may have left the scissor changed
+	glBindFramebuffer( GL_FRAMEBUFFER, target );
+	clipToDirty();
 	nvgBeginFrame( _vg, ww/_uiRatio, wh/_uiRatio, _pxRatio*_uiRatio );
 	nvgOutputGamma(_vg,value_ptr(_windowGamma));
 	nvgOutputColorMat(_vg,value_ptr(_windowColorMat));
+	if( partial ) nvgScissor( _vg, dirty.x, dirty.y, dirty.w, dirty.h );
+	nvgFrameScissor() = _redrawRect;
 	draw( _vg );
 	popupDraw(_vg);
 	if( _tooltipEngaged ) {
 		_tooltipAlpha+=0.2f;
 		if( _tooltipAlpha>1) _tooltipAlpha=1;
-		else animate();
+		else invalidate( tooltipRect(), true );
 		_draw_tooltip(_vg, _tooltipBox, _tooltipDx, _tooltipString, _tooltipAlpha);
 	}
 	else if( _tooltipAlpha>0.f ) {
@@ -395,12 +515,24 @@ inline void Window::render() {
 		if(_tooltipAlpha<0 ) _tooltipAlpha = 0.f;
 		else {
 			_draw_tooltip(_vg, _tooltipBox, _tooltipDx, _tooltipString, _tooltipAlpha);
-			animate();
+			invalidate( tooltipRect(), true );
 		}
 	}
 	nvgEndFrame( _vg );
+	_redrawRect = rct_t(0,0,-1,-1);
+	nvgFrameScissor() = _redrawRect;
+
+	glDisable( GL_SCISSOR_TEST );
+	if( target ) {
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, target );
+		glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+		glBlitFramebuffer( 0, 0, fbw, fbh, 0, 0, fbw, fbh, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	}
 
+	JGL2_PROFILE_ZONE("swapBuffers");
 	glfwSwapBuffers( _glfwWindow );
+	pushFrameFence();
 }
 inline void Window::hide() {
 	if( _glfwWindow && !_hidden )
@@ -477,7 +609,21 @@ inline Widget*	Window::underWidget(const pos_t& pt) {
 inline void Window::dismissTooltip() {
 	_tooltipEngaged = false;
 	_underWidgetChangedTimestamp = 1e10;
-	damage();
+	invalidate( tooltipRect(), false );
+}
+
+// The tooltip box with room for its shadow
+inline rct_t Window::tooltipRect() const {
+	return rct_t( _tooltipBox.x-10, _tooltipBox.y-10, _tooltipBox.w+20, _tooltipBox.h+20 );
+}
+
+inline void Window::invalidate(const rct_t& r, bool animating) {
+	if( animating ) _animated = true;
+	else _damaged = true;
+	rct_t c = intersection( r, rct_t(0,0,w(),h()) );
+	if( c.w<=0 || c.h<=0 ) return;
+	if( _dirtyRect.w<=0 || _dirtyRect.h<=0 ) _dirtyRect = c;
+	else _dirtyRect.increase( c );
 }
 
 inline void Window::updateUnderWidget(const pos_t& pt,float timestamp) {
@@ -503,6 +649,16 @@ inline void Window::updateUnderWidget(const pos_t& pt,float timestamp) {
 //		else if( !isTooltipAvailable )
 			dismissTooltip();
 	}
+	// The loop sleeps while idle; wake it when the tooltip is due to appear or go
+	float delay = -1;
+	if( !_tooltipEngaged && isTooltipAvailable )
+		delay = _underWidgetChangedTimestamp+_def_time_tooltip_hold_to_start-timestamp;
+	else if( _tooltipEngaged && !isTooltipAvailable )
+		delay = _underWidgetChangedTimestamp+_def_time_tooltip_delayed_dismissal-timestamp;
+	if( _tooltipTimer ) _JGL::removeTimer( _tooltipTimer );
+	_tooltipTimer = 0;
+	if( delay>=0 && delay<10 )
+		_tooltipTimer = _JGL::addTimer( delay+.01f, [](){ _JGL::requestUnderWidgetUpdate(); } );
 }
 
 inline void Window::startTooltip() {
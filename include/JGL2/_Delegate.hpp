@@ -0,0 +1,131 @@
+//
+//  _Delegate.hpp
+//  JGL2
+//
+
+#ifndef JGL2__Delegate_h
+#define JGL2__Delegate_h
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace JGL2 {
+
+struct DelegateStats {
+	// Callables that did not fit in place and went to the heap, since the start.
+	// Calling a delegate never allocates, so this stays flat from frame to frame
+	// unless callbacks are being re-assigned with large captures.
+	static inline std::atomic<size_t>&	heapAllocations() { static std::atomic<size_t> n{0}; return n; }
+};
+
+// Drop-in for std::function on callbacks called every frame or mouse event.
+// Callables up to CAPACITY bytes (lambdas capturing a few values or references,
+// function pointers, or a std::function) are stored in place, so assignment does not
+// allocate. Larger ones still work but are kept on the heap and counted in
+// DelegateStats. Calling an empty delegate throws std::bad_function_call.
+template<typename Sig, size_t CAPACITY=48> struct Delegate;
+
+template<typename R, typename... Args, size_t CAPACITY>
+struct Delegate<R(Args...),CAPACITY> {
+
+	Delegate() noexcept {}
+	Delegate(std::nullptr_t) noexcept {}
+	Delegate(const Delegate& d) { copyFrom( d ); }
+	Delegate(Delegate&& d) noexcept { moveFrom( d ); }
+	template<typename F, typename=std::enable_if_t<!std::is_same<std::decay_t<F>,Delegate>::value
+											&& std::is_invocable_r<R,std::decay_t<F>&,Args...>::value>>
+	Delegate(F&& f) { assign( std::forward<F>(f) ); }
+	~Delegate() { reset(); }
+
+	Delegate&		operator=(const Delegate& d) { if( this!=&d ) { reset(); copyFrom( d ); } return *this; }
+	Delegate&		operator=(Delegate&& d) noexcept { if( this!=&d ) { reset(); moveFrom( d ); } return *this; }
+	Delegate&		operator=(std::nullptr_t) noexcept { reset(); return *this; }
+	template<typename F, typename=std::enable_if_t<!std::is_same<std::decay_t<F>,Delegate>::value
+											&& std::is_invocable_r<R,std::decay_t<F>&,Args...>::value>>
+	Delegate&		operator=(F&& f) { reset(); assign( std::forward<F>(f) ); return *this; }
+
+	explicit		operator bool() const noexcept { return _ops!=nullptr; }
+	inline R		operator()(Args... args) const {
+		if( !_ops ) throw std::bad_function_call();
+		return _ops->call( _buf, std::forward<Args>(args)... );
+	}
+	inline void		reset() noexcept { if( _ops ) _ops->destroy( _buf ); _ops = nullptr; }
+
+protected:
+	struct Ops {
+		R		(*call)(void*, Args&&...);
+		void	(*copy)(void* dst, const void* src);
+		void	(*move)(void* dst, void* src) noexcept;
+		void	(*destroy)(void*) noexcept;
+	};
+
+	template<typename F>
+	static constexpr bool fitsInPlace = sizeof(F)<=CAPACITY && alignof(F)<=alignof(std::max_align_t)
+									 && std::is_nothrow_move_constructible<F>::value;
+
+	template<typename F>
+	struct InPlace {
+		static inline F&	get(void* b) { return *std::launder( reinterpret_cast<F*>(b) ); }
+		static inline R		call(void* b, Args&&... args) { return std::invoke( get(b), std::forward<Args>(args)... ); }
+		static inline void	copy(void* d, const void* s) { new(d) F( get(const_cast<void*>(s)) ); }
+		static inline void	move(void* d, void* s) noexcept { new(d) F( std::move(get(s)) ); get(s).~F(); }
+		static inline void	destroy(void* b) noexcept { get(b).~F(); }
+		static constexpr Ops ops = { call, copy, move, destroy };
+	};
+
+	template<typename F>
+	struct OnHeap {
+		static inline F*&	get(void* b) { return *std::launder( reinterpret_cast<F**>(b) ); }
+		static inline R		call(void* b, Args&&... args) { return std::invoke( *get(b), std::forward<Args>(args)... ); }
+		static inline void	copy(void* d, const void* s) {
+			DelegateStats::heapAllocations()++;
+			new(d) F*( new F( *get(const_cast<void*>(s)) ) );
+		}
+		static inline void	move(void* d, void* s) noexcept { new(d) F*( get(s) ); }
+		static inline void	destroy(void* b) noexcept { delete get(b); }
+		static constexpr Ops ops = { call, copy, move, destroy };
+	};
+
+	template<typename F>
+	static inline bool	isNull(const F& f) {
+		if constexpr( std::is_pointer<F>::value || std::is_member_pointer<F>::value ) return f==nullptr;
+		else return false;
+	}
+	template<typename S>
+	static inline bool	isNull(const std::function<S>& f) { return !f; }
+
+	template<typename F>
+	inline void		assign(F&& f) {
+		using T = std::decay_t<F>;
+		if( isNull( f ) ) return;
+		if constexpr( fitsInPlace<T> ) {
+			new(_buf) T( std::forward<F>(f) );
+			_ops = &InPlace<T>::ops;
+		}
+		else {
+			DelegateStats::heapAllocations()++;
+			new(_buf) T*( new T( std::forward<F>(f) ) );
+			_ops = &OnHeap<T>::ops;
+		}
+	}
+	inline void		copyFrom(const Delegate& d) {
+		if( d._ops ) d._ops->copy( _buf, d._buf );
+		_ops = d._ops;
+	}
+	inline void		moveFrom(Delegate& d) noexcept {
+		if( d._ops ) d._ops->move( _buf, d._buf );
+		_ops = d._ops;
+		d._ops = nullptr;
+	}
+
+	alignas(std::max_align_t) mutable unsigned char _buf[CAPACITY];
+	const Ops*		_ops = nullptr;
+};
+
+} // namespace JGL2
+
+#endif /* JGL2__Delegate_h */
@@ -18,6 +18,7 @@
 
 #include <JGL2/_MathTypes.hpp>
 #include <JGL2/_misc.hpp>
+#include <JGL2/_TextLayoutCache.hpp>
 
 namespace JGL2 {
 
@@ -48,9 +49,29 @@ inline void nvgTextAligned(NVGcontext* vg, const rct_t& r, const str_t& str, int
 	nvgText( vg, p.x, p.y, str.c_str(), 0);
 }
 
+// The clip of the frame being drawn, in window coordinates: the dirty rect during a
+// partial redraw (set by Window::render), empty otherwise. Widget clips may be dropped,
+// this one may not, as pixels outside it are kept from the previous frame
+inline rct_t& nvgFrameScissor() {
+	static rct_t r(0,0,-1,-1);
+	return r;
+}
+
+// nvgResetScissor keeping the frame clip, for shadows and glows spilling out of their widget
+inline void nvgResetToFrameScissor(NVGcontext* vg) {
+	nvgResetScissor(vg);
+	const rct_t& r = nvgFrameScissor();
+	if( r.w<=0 || r.h<=0 ) return;
+	float xform[6];
+	nvgCurrentTransform(vg, xform);
+	nvgResetTransform(vg);
+	nvgScissor(vg, r.x, r.y, r.w, r.h);
+	nvgTransform(vg, xform[0], xform[1], xform[2], xform[3], xform[4], xform[5]);
+}
+
 inline void nvgGlowBox(NVGcontext* vg, const rct_t& r, float sz, float radius, const NVGcolor& c) {
 	nvgSave(vg);
-	nvgResetScissor(vg);
+	nvgResetToFrameScissor(vg);
 	NVGpaint shadowPnt = nvgBoxGradient(vg, r.x-sz/2, r.y-sz/2, r.w+sz, r.h+sz,
 										radius+sz/2, sz, c, nvgRGBAf(c.r,c.g,c.g,0));
 	nvgBeginPath(vg);
@@ -125,6 +146,9 @@ inline void drawRoundBoxL(NVGcontext* ctx, const rct_t& rect, float r, const NVG
 }
 
 inline sz2_t nvgMeasureText(NVGcontext* vg, const str_t& str, float pt=-1, const char* font=nullptr ) {
+	// Cached only when the font is fully given; otherwise the current state is measured
+	if( pt>0 && font )
+		return TextLayoutCache::get().layout( vg, str, pt, font ).size();
 	if( pt>0 )
 		nvgFontSize( vg, pt );
 	if( font )
@@ -183,7 +207,7 @@ inline void nvgPathBottomRoundBox( NVGcontext* ctx, float x, float y, float w, f
 
 inline void nvgShadowRect(NVGcontext* vg, const rct_t& r, float sz, const pos_t& offset, float R ) {
 	nvgSave(vg);
-	nvgResetScissor(vg);
+	nvgResetToFrameScissor(vg);
 	
 	NVGpaint shadowPaint = nvgBoxGradient(vg, r.x+offset.x,r.y+offset.y, r.w-offset.x, r.h-offset.y,
 										  R, sz, nvgRGBAf(0,0,0,.12f), nvgRGBAf(0,0,0,0));
@@ -0,0 +1,117 @@
+//
+//  _DrawCache.hpp
+//  JGL2
+//
+
+#ifndef _DrawCache_h
+#define _DrawCache_h
+
+// Included from Window.hpp after nanovg_gl.h
+
+namespace JGL2 {
+
+// Offscreen nanovg image (premultiplied, with a stencil buffer for fills)
+struct _DrawCache {
+	NVGcontext*	vg = nullptr;
+	int			image = 0;
+	GLuint		fbo = 0;
+	GLuint		rbo = 0;
+	int			w = 0, h = 0;
+
+	~_DrawCache() { clear(); }
+	inline bool		valid() const { return fbo>0; }
+	inline void		clear() {
+		if( rbo ) { glDeleteRenderbuffers( 1, &rbo ); rbo = 0; }
+		if( fbo ) { glDeleteFramebuffers( 1, &fbo ); fbo = 0; }
+		if( image && vg ) nvgDeleteImage( vg, image );
+		image = 0;
+		w = h = 0;
+	}
+	inline bool		create( NVGcontext* ctx, int ww, int hh ) {
+		if( valid() && ctx==vg && ww==w && hh==h ) return true;
+		clear();
+		vg = ctx;
+		w = ww;
+		h = hh;
+		image = nvgCreateImageRGBA( vg, w, h, NVG_IMAGE_FLIPY|NVG_IMAGE_PREMULTIPLIED, nullptr );
+		GLint oldFB, oldRB;
+		glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFB );
+		glGetIntegerv( GL_RENDERBUFFER_BINDING, &oldRB );
+		glGenFramebuffers( 1, &fbo );
+		glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+		glGenRenderbuffers( 1, &rbo );
+		glBindRenderbuffer( GL_RENDERBUFFER, rbo );
+		glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h );
+		glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, nvglImageHandleGL3( vg, image ), 0 );
+		glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo );
+		bool complete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer( GL_FRAMEBUFFER, oldFB );
+		glBindRenderbuffer( GL_RENDERBUFFER, oldRB );
+		if( !complete ) clear();
+		return complete;
+	}
+};
+
+// Children first, so that a cached group inside a cached group is drawn from its image
+inline void Group::updateDrawCaches( NVGcontext* vg, float scale ) {
+	{
+		std::unique_lock<std::mutex> lock(_childMutex);
+		for( auto c : _children ) if( c && !c->hidden() ) {
+			Group* g = c->groupPtr();
+			if( g ) g->updateDrawCaches( vg, scale );
+		}
+	}
+	if( !_cacheDrawing ) { _cacheReady = false; return; }
+	int pw = int(ceil(w()*scale)), ph = int(ceil(h()*scale));
+	if( pw<1 || ph<1 ) { _cacheReady = false; return; }
+	if( !_drawCache ) _drawCache = std::make_shared<_DrawCache>();
+	if( !_cacheDirty && _drawCache->valid() && _drawCache->w==pw && _drawCache->h==ph && _cacheScale==scale ) {
+		_cacheReady = true;
+		return;
+	}
+	_cacheReady = _drawCache->create( vg, pw, ph );
+	if( !_cacheReady ) return;
+	_cacheScale = scale;
+	// Cleared before drawing, so that animate() from inside keeps it dirty
+	_cacheDirty = false;
+
+	GLint oldFB, vp[4], sc[4];
+	GLboolean scissor = glIsEnabled( GL_SCISSOR_TEST );
+	glGetIntegerv( GL_FRAMEBUFFER_BINDING, &oldFB );
+	glGetIntegerv( GL_VIEWPORT, vp );
+	glGetIntegerv( GL_SCISSOR_BOX, sc );
+	glBindFramebuffer( GL_FRAMEBUFFER, _drawCache->fbo );
+	glViewport( 0, 0, pw, ph );
+	glDisable( GL_SCISSOR_TEST );
+	glClearColor( 0, 0, 0, 0 );
+	glClear( GL_COLOR_BUFFER_BIT|GL_STENCIL_BUFFER_BIT );
+
+	// Identity output transform; the window's gamma and color matrix apply when the image is drawn
+	const float gamma[3] = { 2.4f, 2.4f, 2.4f };
+	const float colorMat[9] = { 1,0,0, 0,1,0, 0,0,1 };
+	nvgBeginFrame( vg, w(), h(), scale );
+	nvgOutputGamma( vg, gamma );
+	nvgOutputColorMat( vg, colorMat );
+	Widget::draw( vg );
+	nvgEndFrame( vg );
+
+	glBindFramebuffer( GL_FRAMEBUFFER, oldFB );
+	glViewport( vp[0], vp[1], vp[2], vp[3] );
+	glScissor( sc[0], sc[1], sc[2], sc[3] );
+	if( scissor ) glEnable( GL_SCISSOR_TEST );
+}
+
+inline bool Group::drawCached( NVGcontext* vg ) {
+	if( !_cacheDrawing || !_cacheReady || !_drawCache || !_drawCache->valid() ) return false;
+	float iw = _drawCache->w/_cacheScale, ih = _drawCache->h/_cacheScale;
+	NVGpaint img = nvgImagePattern( vg, 0, 0, iw, ih, 0, _drawCache->image, 1 );
+	nvgBeginPath( vg );
+	nvgRect( vg, 0, 0, w(), h() );
+	nvgFillPaint( vg, img );
+	nvgFill( vg );
+	return true;
+}
+
+} // namespace JGL2
+
+#endif /* _DrawCache_h */
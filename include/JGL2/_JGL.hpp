@@ -10,7 +10,9 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <set>
+#include <algorithm>
 
 #ifdef __APPLE__
 #pragma clang visibility push(default)
@@ -35,9 +37,12 @@
 #endif
 
 #include <JGL2/_MathTypes.hpp>
+#include <JGL2/_Profiler.hpp>
+#include <JGL2/_TaskPool.hpp>
 #include <nanovg/nanovg.h>
 
 #include <GLFW/glfw3.h>
+#include <JGL2/_RenderThread.hpp>
 #include <queue>
 #include <functional>
 
@@ -187,11 +192,18 @@ protected:
 	struct _RunOnUIThreadItem {
 		std::function<void(void*ud)> func;
 		void* ud = nullptr;
+		_RunOnUIThreadItem() {}
 		_RunOnUIThreadItem(std::function<void(void*ud)> fun, void* userData=nullptr) : func(fun), ud(userData){}
 		void run() { func(ud); }
 	};
+	
+	struct _TimerItem {
+		double					deadline;	// glfwGetTime()
+		size_t					id;
+		std::function<void()>	func;
+	};
 
-	using run_item_queue_t	= std::queue<_RunOnUIThreadItem>;
+	using run_item_queue_t	= _MPSCQueue<_RunOnUIThreadItem>;
 	using event_queue_t		= std::queue<_EventQueueItem>;
 
 
@@ -203,6 +215,19 @@ protected:
 	button_t 			_pressedButtons = button_t::NONE;
 	mod_t  				_modState = mod_t::NONE;
 	run_item_queue_t	_runOnUIThreadQueue;
+	std::unique_ptr<_ThreadPool>	_threadPool;
+	std::unique_ptr<_RenderThread>	_renderThread;
+	std::once_flag		_threadPoolFlag;
+	// Called with a context current right before it is destroyed
+	std::vector<void(*)(GLFWwindow*)>	_contextReleasers;
+	std::mutex			_contextReleaserMutex;
+	
+	// Deadlines the main loop sleeps until; fired on the UI thread
+	std::vector<_TimerItem>	_timers;
+	size_t				_timerSerial = 0;
+	std::mutex			_timerMutex;
+	bool				_underWidgetUpdatePending = true;
+	std::atomic<bool>	_running = false;
 
 	
 	// Adding group
@@ -240,6 +265,19 @@ protected:
 
 	std::function<void(const std::filesystem::path&)> _openDocumentCB=[](const std::filesystem::path&){};
 	
+	// Frame pacing: how many frames a window may queue ahead of the GPU, and
+	// whether the swaps of the pacing window (see __pacingWindow) wait for the vertical blank
+	int					_framesInFlight = 2;
+	bool				_vsync = true;
+	
+	// Cursor motion and scrolling held back by the GLFW callbacks and dispatched once per
+	// loop iteration (latest position, summed scroll). Any other input flushes them first
+	bool				_coalesceEvents = true;
+	GLFWwindow*			_pendingMoveWindow = nullptr;
+	double				_pendingMoveX = 0, _pendingMoveY = 0;
+	GLFWwindow*			_pendingScrollWindow = nullptr;
+	double				_pendingScrollX = 0, _pendingScrollY = 0;
+	
 	
 	
 	
@@ -288,16 +326,29 @@ protected:
 	bool					__getCurrentDrawWindowFocused();
 	float					__getCurrentDrawWindowPxRatio();
 	float					__getCurrentDrawWindowUIRatio();
+	rct_t					__getCurrentDrawWindowRedrawRect();
+	GLuint					__getCurrentDrawWindowFramebuffer();
 	void					__drawAsChild( NVGcontext* vg, Widget* w );
 	void					__setCursor( cursor_t cursor );
 	void					__runOnUIThread( std::function<void(void*ud)> func, void* ud=nullptr );
+	_ThreadPool&			__threadPool();
+	_RenderThread&			__renderThread();
+	size_t					__addTimer( double delay, std::function<void()> func );
+	void					__removeTimer( size_t id );
+	double					__runTimers();
 	void					__propagateLeaveEnter( Widget* w, const pos_t& oldPt, const pos_t& newPt );
 	void					__registerWindow( Window* win );
 	void					__registerWindowCallbacks( Window* win );
 	GLFWwindow* 			__getShaderableContext();
 	Window*					__eventWindow_();
 	idx_t					__searchWindow( GLFWwindow* window );
+	Window*					__pacingWindow( const std::vector<Window*>& swapping );
+	void					__addContextReleaser( void(*fn)(GLFWwindow*) );
+	void					__releaseContext( GLFWwindow* ctx );
 	void					__mousePositionCallback( GLFWwindow* window, double x, double y);
+	void					__dispatchMousePosition( GLFWwindow* window, double x, double y);
+	void					__dispatchScroll( GLFWwindow* window, double dx, double dy);
+	void					__flushCoalescedEvents();
 	void					__mouseButtonCallback( GLFWwindow* window, int button, int action, int mods );
 	void					__keyCallback( GLFWwindow* window, int key, int scan, int action, int mods );
 	void					__charCallback( GLFWwindow* window, unsigned int codepoint);
@@ -361,6 +412,12 @@ public:
 
 	//* Run
 	static void				run() { get().__run(); }
+	static void				framesInFlight( int n ) { get()._framesInFlight = std::min( std::max( n, 1 ), 3 ); }
+	static int				framesInFlight() { return get()._framesInFlight; }
+	static void				vsync( bool b ) { get()._vsync = b; }
+	static bool				vsync() { return get()._vsync; }
+	static void				coalesceEvents( bool b ) { get().__flushCoalescedEvents(); get()._coalesceEvents = b; }
+	static bool				coalesceEvents() { return get()._coalesceEvents; }
 	
 	
 	//* Window drawing management
@@ -370,6 +427,8 @@ public:
 	static bool				getCurrentDrawWindowFocused() { return get().__getCurrentDrawWindowFocused(); }
 	static float			getCurrentDrawWindowPxRatio() { return get().__getCurrentDrawWindowPxRatio(); }
 	static float			getCurrentDrawWindowUIRatio() { return get().__getCurrentDrawWindowUIRatio(); }
+	static rct_t			getCurrentDrawWindowRedrawRect() { return get().__getCurrentDrawWindowRedrawRect(); }
+	static GLuint			getCurrentDrawWindowFramebuffer() { return get().__getCurrentDrawWindowFramebuffer(); }
 
 	//* A function to be called for drawing a child (or member) widget
 	static void				drawAsChild( NVGcontext* vg, Widget* w ) { get().__drawAsChild(vg,w); }
@@ -378,6 +437,24 @@ public:
 	static void				setCursor( cursor_t cursor ) { get().__setCursor(cursor); }
 	
 	static void				runOnUIThread(std::function<void(void*ud)> func, void* ud=nullptr) { get().__runOnUIThread(func,ud); }
+	//* Runs work on the worker pool; chain .then_on_ui(apply) to use the result on the UI thread
+	template<typename F>
+	static auto				async( F&& work ) { return get().__threadPool().async( std::forward<F>(work) ); }
+	static _ThreadPool&		threadPool() { return get().__threadPool(); }
+	//* GL thread for views rendering off the UI thread; main thread only
+	static _RenderThread&	renderThread() { return get().__renderThread(); }
+	// False before first use and after run() returned, when the thread and its context are gone
+	static bool				hasRenderThread() { return bool(get()._renderThread); }
+	//* fn(ctx) runs with ctx current right before a window's or the render thread's context
+	//* is destroyed, to free GL objects kept per context
+	static void				addContextReleaser( void(*fn)(GLFWwindow*) ) { get().__addContextReleaser(fn); }
+	//* Calls func on the UI thread after delay seconds; safe from any thread. Returns an id for removeTimer()
+	static size_t			addTimer( double delay, std::function<void()> func ) { return get().__addTimer(delay,func); }
+	static void				removeTimer( size_t id ) { get().__removeTimer(id); }
+	//* Wakes the main loop from any thread
+	static void				wakeUp() { if( get()._running ) glfwPostEmptyEvent(); }
+	//* Re-evaluates the widget under the mouse (and its tooltip) on the next loop iteration
+	static void				requestUnderWidgetUpdate() { get()._underWidgetUpdatePending = true; }
 	static void				setOpenDoumentCB(std::function<void(const std::filesystem::path& path)> fn) { get().__setOpenDoumentCB(fn); }
 protected:
 	
@@ -390,6 +467,7 @@ protected:
 	static void				registerWindow( Window* win ) { get().__registerWindow(win); }
 	static void				registerWindowCallbacks( Window* win ) { get().__registerWindowCallbacks(win); }
 	static GLFWwindow* 		getShaderableContext() { return get().__getShaderableContext(); }
+	static void				releaseContext( GLFWwindow* ctx ) { get().__releaseContext(ctx); }
 
 	
 	static Window*			eventWindow_() { return get().__eventWindow_(); }
@@ -596,7 +674,7 @@ inline bool _JGL::__sendEvent( Widget* w, event_t event ) {
 }
 
 inline bool _JGL::__dispatchEvent( Widget* w, event_t event ) {
-	Window* win = dynamic_cast<Window*>(w);
+	Window* win = w?w->windowPtr():nullptr;
 	if( win && win->hasPopup() ) {
 		bool ret = win->popupHandle( event );
 		if( event == event_t::KEYDOWN && eventKey() == GLFW_KEY_ESCAPE )
@@ -607,8 +685,8 @@ inline bool _JGL::__dispatchEvent( Widget* w, event_t event ) {
 	if( w && w->active() && !w->hidden() ) {
 		_JGL::eventContext( w );
 		
-		Group* group = dynamic_cast<Group*>(w);
-		_Scrollable* scroller = dynamic_cast<_Scrollable*>(w);
+		Group* group = w->groupPtr();
+		_Scrollable* scroller = w->scrollablePtr();
 		
 		if( event == event_t::SCROLL && group ) {
 			if( group->propagateEvent( event ) )
@@ -638,7 +716,7 @@ inline void _JGL::__propagateLeaveEnter( Widget* w, const pos_t& oldPt, const po
 		__dispatchEvent( w, event_t::LEAVE );
 	else if( !w->under(oldPt) && w->under( newPt ) )
 		__dispatchEvent( w, event_t::ENTER );
-	Group* g = dynamic_cast<Group*>(w);
+	Group* g = w->groupPtr();
 	if( g ) {
 		g->forAllChild([&](auto c){
 			__propagateLeaveEnter( c, oldPt, newPt );
@@ -654,7 +732,57 @@ inline idx_t _JGL::__searchWindow( GLFWwindow* window ) {
 	return -1;
 }
 
+// The one window, among those swapping in this iteration, whose swaps wait for vblank:
+// the focused one, or else the first in window order. It caps the whole loop at the
+// refresh rate; the others swap immediately and are paced by their frame fences, so that
+// N windows do not run at 1/N of the refresh rate. The choice only moves with the focus
+// or when a window starts or stops redrawing, not from frame to frame
+inline Window* _JGL::__pacingWindow( const std::vector<Window*>& swapping ) {
+	if( _focusedWindow<_windows.size()
+	   && std::find( swapping.begin(), swapping.end(), _windows[_focusedWindow] )!=swapping.end() )
+		return _windows[_focusedWindow];
+	return swapping.empty() ? nullptr : swapping.front();
+}
+
+inline void _JGL::__addContextReleaser( void(*fn)(GLFWwindow*) ) {
+	std::unique_lock<std::mutex> lock(_contextReleaserMutex);
+	if( std::find( _contextReleasers.begin(), _contextReleasers.end(), fn )==_contextReleasers.end() )
+		_contextReleasers.push_back( fn );
+}
+
+inline void _JGL::__releaseContext( GLFWwindow* ctx ) {
+	if( !ctx ) return;
+	std::vector<void(*)(GLFWwindow*)> fns;
+	{
+		std::unique_lock<std::mutex> lock(_contextReleaserMutex);
+		fns = _contextReleasers;
+	}
+	for( auto fn: fns ) fn( ctx );
+}
+
+inline void _JGL::__flushCoalescedEvents() {
+	if( _pendingMoveWindow ) {
+		GLFWwindow* w = _pendingMoveWindow;
+		_pendingMoveWindow = nullptr;
+		__dispatchMousePosition( w, _pendingMoveX, _pendingMoveY );
+	}
+	if( _pendingScrollWindow ) {
+		GLFWwindow* w = _pendingScrollWindow;
+		_pendingScrollWindow = nullptr;
+		__dispatchScroll( w, _pendingScrollX, _pendingScrollY );
+	}
+}
+
 inline void _JGL::__mousePositionCallback( GLFWwindow* window, double x, double y) {
+	if( !_coalesceEvents ) { __dispatchMousePosition( window, x, y ); return; }
+	if( _pendingScrollWindow || (_pendingMoveWindow && _pendingMoveWindow!=window) )
+		__flushCoalescedEvents();
+	_pendingMoveWindow = window;
+	_pendingMoveX = x;
+	_pendingMoveY = y;
+}
+
+inline void _JGL::__dispatchMousePosition( GLFWwindow* window, double x, double y) {
 	idx_t win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -664,6 +792,7 @@ inline void _JGL::__mousePositionCallback( GLFWwindow* window, double x, double
 		_mousePt = pos_t( float(x), float(y) )/_currentEventWindow->uiRatio();
 
 		_currentUnderWidget = _windows[win]->underMouse();
+		_underWidgetUpdatePending = true;
 		
 		std::set<Widget*> oldUnderWidgets;
 		if( eventMods(mod_t::LBUTTON ) )
@@ -688,6 +817,7 @@ inline void _JGL::__mousePositionCallback( GLFWwindow* window, double x, double
 }
 		
 inline void _JGL::__mouseButtonCallback( GLFWwindow* window, int button, int action, int mods ) {
+	__flushCoalescedEvents();
 	idx_t win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -785,13 +915,15 @@ inline void _JGL::__mouseButtonCallback( GLFWwindow* window, int button, int act
 }
 
 inline void _JGL::__resizeCallback( GLFWwindow* window, int w, int h ) {
+	__flushCoalescedEvents();
 	int win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
 		_windows[win]->dismissTooltip();
 		_windows[win]->size( sz2_t(float(w),float(h))/_windows[win]->uiRatio() );
 		_windows[win]->reform(_windows[win]->nvgContext(),autoscale_t::NONE);
-		_windows[win]->render();
+		// The only window swapping here, so it paces itself
+		_windows[win]->render( _framesInFlight, _vsync );
 	}
 }
 
@@ -800,6 +932,7 @@ inline void _JGL::__fbResizeCallback( GLFWwindow* window, int w, int h ) {
 
 
 inline void _JGL::__windowFocusCallback( GLFWwindow* window, int focus ) {
+	__flushCoalescedEvents();
 	int win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -827,6 +960,16 @@ inline void _JGL::__windowFocusCallback( GLFWwindow* window, int focus ) {
 }
 
 inline void _JGL::__scrollCallback( GLFWwindow* window,  double dx, double dy ) {
+	if( !_coalesceEvents ) { __dispatchScroll( window, dx, dy ); return; }
+	if( _pendingMoveWindow || (_pendingScrollWindow && _pendingScrollWindow!=window) )
+		__flushCoalescedEvents();
+	if( !_pendingScrollWindow ) _pendingScrollX = _pendingScrollY = 0;
+	_pendingScrollWindow = window;
+	_pendingScrollX += dx;
+	_pendingScrollY += dy;
+}
+
+inline void _JGL::__dispatchScroll( GLFWwindow* window,  double dx, double dy ) {
 	int win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -840,6 +983,7 @@ inline void _JGL::__scrollCallback( GLFWwindow* window,  double dx, double dy )
 }
 
 inline void _JGL::__zoomCallback( GLFWwindow* window,  double factor ) {
+	__flushCoalescedEvents();
 	int win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -853,6 +997,7 @@ inline void _JGL::__zoomCallback( GLFWwindow* window,  double factor ) {
 }
 
 inline void _JGL::__charCallback( GLFWwindow* window, unsigned int codePoint) {
+	__flushCoalescedEvents();
 	int win = __searchWindow( window );
 	if( win>=0 ) {
 		_currentEventWindow = _windows[win];
@@ -868,6 +1013,7 @@ inline void _JGL::__charCallback( GLFWwindow* window, unsigned int codePoint) {
 }
 
 inline void _JGL::__keyCallback( GLFWwindow* window, int key, int scan, int action, int mods ) {
+	__flushCoalescedEvents();
 	if( action == GLFW_PRESS ) {
 		switch( key ) {
 			case GLFW_KEY_LEFT_SHIFT	: _modState=_modState|mod_t::LSHIFT		; break;
@@ -939,6 +1085,7 @@ inline void _JGL::__keyCallback( GLFWwindow* window, int key, int scan, int acti
 }
 
 inline void _JGL::__dragAndDropCallback( GLFWwindow* window, int n, const char* str[] ) {
+	__flushCoalescedEvents();
 	_eventDropedStrings.clear();
 	for( int i=0; i<n; i++ )
 		_eventDropedStrings.push_back( str[i] );
@@ -966,6 +1113,7 @@ inline void _JGL::__dragAndDropCallback( GLFWwindow* window, int n, const char*
 
 
 inline void _JGL::__contentsScaleCallback(GLFWwindow* window, float sx, float sy ) {
+	__flushCoalescedEvents();
 #ifdef _MSC_VER
 	int win = __searchWindow( window );
 	_windows[win]->uiRatio(std::min(sx,sy), true);
@@ -1023,25 +1171,80 @@ inline GLFWwindow* _JGL::__getShaderableContext() {
 
 inline void _JGL::__runOnUIThread(std::function<void(void*ud)> func, void* ud) {
 	_runOnUIThreadQueue.push(_RunOnUIThreadItem(func,ud));
+	wakeUp();
+}
+
+inline void _postToUIThread( std::function<void()> f ) {
+	_JGL::runOnUIThread( [f=std::move(f)](void*){ f(); } );
+}
+
+inline _RenderThread& _JGL::__renderThread() {
+	if( !_renderThread ) _renderThread = std::make_unique<_RenderThread>( __getShaderableContext() );
+	return *_renderThread;
+}
+
+// Started on first use, so that applications without background work spawn no threads
+inline _ThreadPool& _JGL::__threadPool() {
+	std::call_once( _threadPoolFlag, [this]{ _threadPool = std::make_unique<_ThreadPool>(); } );
+	return *_threadPool;
+}
+
+inline size_t _JGL::__addTimer( double delay, std::function<void()> func ) {
+	size_t id;
+	{
+		std::unique_lock<std::mutex> lock(_timerMutex);
+		id = ++_timerSerial;
+		_timers.push_back( { glfwGetTime()+delay, id, func } );
+	}
+	wakeUp();
+	return id;
+}
+
+inline void _JGL::__removeTimer( size_t id ) {
+	std::unique_lock<std::mutex> lock(_timerMutex);
+	_timers.erase( std::remove_if( _timers.begin(), _timers.end(), [id](const _TimerItem& t){ return t.id==id; } ), _timers.end() );
+}
+
+// Fires the due timers, returns the seconds until the next one or -1 when none is left
+inline double _JGL::__runTimers() {
+	std::vector<_TimerItem> due;
+	double now = glfwGetTime(), next = -1;
+	{
+		std::unique_lock<std::mutex> lock(_timerMutex);
+		for( auto it=_timers.begin(); it!=_timers.end(); ) {
+			if( it->deadline<=now ) { due.push_back( std::move(*it) ); it = _timers.erase(it); }
+			else { if( next<0 || it->deadline-now<next ) next = it->deadline-now; it++; }
+		}
+	}
+	for( auto& t: due ) t.func();
+	return due.empty() ? next : 0;
 }
 
 inline void _JGL::__run() {
+	_running = true;
 	while( true ) {
-		while( !_eventQueue.empty() ) {
-			_EventQueueItem item = _eventQueue.front();
-			_eventQueue.pop();
-			if( item.event == event_t::DISMISS_POPUP )
-				__handleDismissPopupEvent( item );
-			else if( item.target && item.event!=event_t::NONE )
-				__dispatchEvent( item.target, item.event );
+		JGL2_PROFILE_ZONE("_JGL::__run");
+		{
+			JGL2_PROFILE_ZONE("dispatchEvents");
+			while( !_eventQueue.empty() ) {
+				_EventQueueItem item = _eventQueue.front();
+				_eventQueue.pop();
+				if( item.event == event_t::DISMISS_POPUP )
+					__handleDismissPopupEvent( item );
+				else if( item.target && item.event!=event_t::NONE )
+					__dispatchEvent( item.target, item.event );
+			}
 		}
-		while( !_runOnUIThreadQueue.empty() ) {
-			_RunOnUIThreadItem item = _runOnUIThreadQueue.front();
-			_runOnUIThreadQueue.pop();
-			item.run();
+		{
+			JGL2_PROFILE_ZONE("runOnUIThread");
+			_RunOnUIThreadItem item;
+			while( _runOnUIThreadQueue.pop( item ) )
+				item.run();
 		}
+		double nextTimer = __runTimers();
 		bool openWindowExisted = false;
 		bool animating = false;
+		std::vector<Window*> damagedWindows;
 		for(auto w: _windows) {
 			if( w && !w->hidden() && !w->destroyed() ) {
 				if( w->shoudClosed() ) {
@@ -1050,35 +1253,74 @@ inline void _JGL::__run() {
 				else {
 					openWindowExisted = true;
 					if( w->changed() ) {
+						JGL2_PROFILE_ZONE("reform");
 						w->reform(w->nvgContext(),autoscale_t::NONE);
 					}
 					if( w->popupChanged() ) {
+						JGL2_PROFILE_ZONE("popupReform");
 						// TODO: popup reform function need the consideration of window size
 						// TODO: and corresponding autoscaling flags setting
 						w->popupReform(w->nvgContext(),autoscale_t::ALL);
 					}
-					if( w->damaged() /*|| w->popupDamaged()*/ ) {
-						w->render();
-					}
+					if( w->damaged() /*|| w->popupDamaged()*/ )
+						damagedWindows.push_back(w);
 				}
-				glFinish();
+			}
+		}
+		Window* pacing = __pacingWindow( damagedWindows );
+		for( auto w: damagedWindows ) {
+			JGL2_PROFILE_ZONE("Window::render");
+			w->render( _framesInFlight, _vsync && w==pacing );
+		}
+		// Layout may have moved widgets under a still mouse
+		if( !damagedWindows.empty() ) _underWidgetUpdatePending = true;
+		for(auto w: _windows) {
+			if( w && !w->hidden() && !w->destroyed() ) {
 				if( w->animated() ) {
-					w->damage();
+					// The animated rects are already recorded; only flag the window
+					w->invalidate( rct_t(0,0,0,0), false );
 					w->clearAnimated();
 					animating = true;
 				}
+				else if( w->damaged() )
+					animating = true;
 			}
 		}
 		if( !openWindowExisted ) break;
+		if( !_runOnUIThreadQueue.empty() ) animating = true;
+		JGL2_PROFILE_ZONE("pollEvents");
+		// Sleep until an event, a posted empty event (runOnUIThread, addTimer) or the next timer
 		if( animating )
 			glfwPollEvents();
+		else if( nextTimer>=0 )
+			glfwWaitEventsTimeout( nextTimer );
 		else
-			glfwWaitEventsTimeout(0.1);
-		if( _focusedWindow>=0 && _windows[_focusedWindow] ) {
+			glfwWaitEvents();
+		__flushCoalescedEvents();
+		if( _underWidgetUpdatePending && _focusedWindow<_windows.size() && _windows[_focusedWindow] ) {
+			_underWidgetUpdatePending = false;
 			Window* win = _windows[_focusedWindow];
 			win->updateUnderWidget( eventWindowPt(), float(glfwGetTime()) );
 		}
 	}
+	_running = false;
+	// Finish background work while the application is still alive, and deliver its
+	// then_on_ui() continuations
+	if( _threadPool ) {
+		_threadPool->shutdown( true );
+		_RunOnUIThreadItem item;
+		while( _runOnUIThreadQueue.pop( item ) )
+			item.run();
+	}
+	// Windows still open and the render thread lose their contexts to glfwTerminate
+	for( auto w: _windows ) {
+		if( w && !w->destroyed() && w->glfwWindow() ) {
+			glfwMakeContextCurrent( w->glfwWindow() );
+			__releaseContext( w->glfwWindow() );
+		}
+	}
+	if( _renderThread ) _renderThread->post( [this]{ __releaseContext( glfwGetCurrentContext() ); } );
+	_renderThread.reset();
 	glfwTerminate();
 }
 
@@ -1145,7 +1387,7 @@ inline bool _JGL::__startPopup( Widget* w, Widget* parent, const pos_t& p, pop_r
 inline void _JGL::__drawAsChild( NVGcontext* vg, Widget* w ) {
 	nvgSave( vg );
 	if( w->parent() ) {
-		_Scrollable* scroller = dynamic_cast<_Scrollable*>(w->parent());
+		_Scrollable* scroller = w->parent()->scrollablePtr();
 		if( scroller )
 			nvgTranslate(vg, -scroller->scrollOffset().x, -scroller->scrollOffset().y );
 	}
@@ -1177,6 +1419,14 @@ inline float _JGL::__getCurrentDrawWindowPxRatio() {
 inline float _JGL::__getCurrentDrawWindowUIRatio() {
 	return _currentDrawWindow?_currentDrawWindow->uiRatio():1.f;
 }
+
+inline rct_t _JGL::__getCurrentDrawWindowRedrawRect() {
+	return _currentDrawWindow?_currentDrawWindow->redrawRect():rct_t(0,0,-1,-1);
+}
+
+inline GLuint _JGL::__getCurrentDrawWindowFramebuffer() {
+	return _currentDrawWindow?_currentDrawWindow->drawFramebuffer():0;
+}
 				
 inline NVGcontext* _JGL::__getCurrentNVGContext() {
 	return _currentDrawWindow?_currentDrawWindow->nvgContext():(_windows.size()>0?_windows[0]->nvgContext():nullptr);
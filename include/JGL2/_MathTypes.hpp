@@ -24,6 +24,7 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
 namespace JGL2 {
 #ifdef JGL2_USE_GLM
@@ -95,6 +96,16 @@ inline transf3_t to3DTransform(const transf2_t& m) {
 					 m[2][0],m[2][1],0,m[2][2]);
 }
 
+inline rct_t intersection(const rct_t& a, const rct_t& b) {
+	float l = std::max(a.x,b.x), t = std::max(a.y,b.y);
+	float r = std::min(a.x+a.w,b.x+b.w), bt = std::min(a.y+a.h,b.y+b.h);
+	return rct_t( l, t, std::max(r-l,0.f), std::max(bt-t,0.f) );
+}
+
+inline bool overlaps(const rct_t& a, const rct_t& b) {
+	return a.x<b.x+b.w && b.x<a.x+a.w && a.y<b.y+b.h && b.y<a.y+a.h;
+}
+
 } // namespace JGL2
 
 #ifdef __APPLE__
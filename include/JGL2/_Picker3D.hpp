@@ -15,8 +15,8 @@ using JR::vec3;
 using JR::vec4;
 using JR::mat4;
 
-typedef std::function<bool(const vec3&)> Motion3DCallback_t;
-typedef std::function<bool(button_t,const vec3&)> Button3DCallback_t;
+typedef Delegate<bool(const vec3&)> Motion3DCallback_t;
+typedef Delegate<bool(button_t,const vec3&)> Button3DCallback_t;
 
 struct _Picker3D {
 	virtual inline vec3		eventPt3D() { return _cursorPt3; }
@@ -40,6 +40,8 @@ struct _Picker3D {
 	virtual std::tuple<vec3,float> get3DCursorPos(const sz2_t& sz, const mat4& vp, float windowH);
 	
 	virtual vec3			getNCCursorPos(float d, const sz2_t& sz, float windowH);
+	// Depth at framebuffer pixel pt, from the framebuffer the window last drew into
+	virtual float			readDepth(const pos_t& pt);
 	virtual vec3			get3DCursorPos(float d, const sz2_t& sz, const mat4& vp, float windowH);
 	
 	virtual inline void		lockCursorDepth() { _cursorDepthLocked = true; }
@@ -98,12 +100,22 @@ inline pos_t _Picker3D::getFramebufferCursorPos(float windowH) {
 
 inline std::tuple<vec3,float> _Picker3D::getNCCursorPos(const sz2_t& sz, float windowH) {
 	pos_t pt = getFramebufferCursorPos(windowH);
-	float d = 0;
-	glReadPixels(int(round(pt.x)), int(round(pt.y)), 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &d);
+	float d = readDepth(pt);
 	auto pt3 = vec3( pt/(vec2(sz.w,sz.h)*_JGL::getCurrentDrawWindowPxRatio()), d)*2-1;
 	return std::make_tuple(pt3,d);
 }
 
+inline float _Picker3D::readDepth(const pos_t& pt) {
+	float d = 0;
+	GLint oldRead;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &oldRead);
+	// The window's offscreen copy in partial redraw mode; its blit to the screen is color only
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _JGL::getCurrentDrawWindowFramebuffer());
+	glReadPixels(int(round(pt.x)), int(round(pt.y)), 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &d);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, oldRead);
+	return d;
+}
+
 inline vec3 _Picker3D::getNCCursorPos(float d, const sz2_t& sz, float windowH) {
 	pos_t pt = getFramebufferCursorPos(windowH);
 	auto pt3 = vec3( pt/(vec2(sz.w,sz.h)*_JGL::getCurrentDrawWindowPxRatio()), d)*2-1;
@@ -210,7 +210,7 @@ inline bool _Popup::under(const pos_t& pt) const {
 
 inline Widget* _Popup::underWidget(const pos_t& pt) const {
 	if( _content ) {
-		Group* g = dynamic_cast<Group*>(_content );
+		Group* g = _content->groupPtr();
 		if( g ) {
 			Widget* ret = g->underWidget(pt);
 			if( ret ) return ret;
@@ -0,0 +1,101 @@
+//
+//  _Profiler.hpp
+//  JGL2
+//
+
+#ifndef _Profiler_h
+#define _Profiler_h
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <fstream>
+
+#ifdef JGL2_PROFILE
+#include <nlohmann/json.hpp>
+#endif
+
+namespace JGL2 {
+
+// CPU timing zones recorded into a fixed ring (the latest CAPACITY zones are kept).
+// Zones are placed with JGL2_PROFILE_ZONE("name") and compile to nothing unless
+// JGL2_PROFILE is defined; the ring is written as Chrome/Perfetto trace JSON with
+// Profiler::dump(). Names must be string literals. Recording is safe from any
+// thread; dump from the UI thread while other threads are not recording.
+struct Profiler {
+	using clock = std::chrono::steady_clock;
+	static constexpr size_t CAPACITY = 1<<16;
+
+	struct Zone {
+		const char*	name = nullptr;
+		int64_t		start = 0;		// us since the profiler started
+		int64_t		dur = 0;
+		int			tid = 0;
+	};
+
+	struct Scope {
+		Scope(const char* n): name(n) { origin(); start = clock::now(); }
+		~Scope() { Profiler::record(name, start, clock::now()); }
+		const char*			name;
+		clock::time_point	start;
+	};
+
+	static inline void		record(const char* name, clock::time_point s, clock::time_point e);
+	static inline void		clear() { head() = 0; }
+	// Writes chrome://tracing JSON; returns false when profiling is compiled out or the file fails
+	static inline bool		dump(const std::string& fn);
+
+protected:
+	static inline Zone*					zones() { static Zone z[CAPACITY]; return z; }
+	static inline std::atomic<size_t>&	head() { static std::atomic<size_t> h{0}; return h; }
+	static inline clock::time_point		origin() { static clock::time_point t = clock::now(); return t; }
+	static inline int					threadId();
+};
+
+inline int Profiler::threadId() {
+	static std::atomic<int> nThreads{0};
+	thread_local int tid = nThreads++;
+	return tid;
+}
+
+inline void Profiler::record(const char* name, clock::time_point s, clock::time_point e) {
+	using namespace std::chrono;
+	Zone& z = zones()[ head()++ % CAPACITY ];
+	z.name	= name;
+	z.start	= duration_cast<microseconds>( s-origin() ).count();
+	z.dur	= duration_cast<microseconds>( e-s ).count();
+	z.tid	= threadId();
+}
+
+inline bool Profiler::dump(const std::string& fn) {
+#ifdef JGL2_PROFILE
+	size_t n = head().load();
+	size_t first = n>CAPACITY ? n-CAPACITY : 0;
+	nlohmann::json events = nlohmann::json::array();
+	for( size_t i=first; i<n; i++ ) {
+		const Zone& z = zones()[i%CAPACITY];
+		if( !z.name ) continue;
+		events.push_back( { {"name",z.name}, {"cat","JGL2"}, {"ph","X"},
+			{"ts",z.start}, {"dur",z.dur}, {"pid",0}, {"tid",z.tid} } );
+	}
+	std::ofstream fs( fn );
+	if( !fs.is_open() ) return false;
+	fs << nlohmann::json{ {"traceEvents",events}, {"displayTimeUnit","ms"} };
+	return fs.good();
+#else
+	(void)fn;
+	return false;
+#endif
+}
+
+} // namespace JGL2
+
+#define _JGL2_PROFILE_CAT2(a,b) a##b
+#define _JGL2_PROFILE_CAT(a,b) _JGL2_PROFILE_CAT2(a,b)
+#ifdef JGL2_PROFILE
+#define JGL2_PROFILE_ZONE(name) JGL2::Profiler::Scope _JGL2_PROFILE_CAT(__jgl2_zone_,__LINE__)(name)
+#else
+#define JGL2_PROFILE_ZONE(name)
+#endif
+
+#endif /* _Profiler_h */
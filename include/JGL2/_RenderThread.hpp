@@ -0,0 +1,86 @@
+//
+//  _RenderThread.hpp
+//  JGL2
+//
+
+#ifndef _RenderThread_h
+#define _RenderThread_h
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace JGL2 {
+
+// A thread owning a hidden GL context shared with the windows. Jobs run in order
+// with that context current. Create and destroy on the main thread (GLFW windows
+// may only be made there).
+struct _RenderThread {
+	_RenderThread( GLFWwindow* share ) {
+		glfwWindowHint( GLFW_VISIBLE, false );
+		_context = glfwCreateWindow( 16, 16, "", nullptr, share );
+		glfwWindowHint( GLFW_VISIBLE, true );
+		_thread = std::thread( [this]{ loop(); } );
+	}
+	~_RenderThread() {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_cv.notify_all();
+		if( _thread.joinable() ) _thread.join();
+		if( _context ) glfwDestroyWindow( _context );
+	}
+	inline void		post( std::function<void()> job ) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_jobs.push_back( std::move(job) );
+		}
+		_cv.notify_all();
+	}
+	// Blocks until every job posted so far has finished
+	inline void		wait() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cv.wait( lock, [&]{ return _jobs.empty() && !_busy; } );
+	}
+	inline bool		valid() const { return _context!=nullptr; }
+
+protected:
+	GLFWwindow*							_context = nullptr;
+	std::thread							_thread;
+	std::mutex							_mutex;
+	std::condition_variable				_cv;
+	std::deque<std::function<void()>>	_jobs;
+	bool								_busy = false;
+	bool								_stop = false;
+
+	inline void		loop() {
+		if( !_context ) return;
+		glfwMakeContextCurrent( _context );
+#ifdef _MSC_VER
+		glewInit();
+		glEnable(GL_FRAMEBUFFER_SRGB);
+#endif
+		while( true ) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_busy = false;
+				_cv.notify_all();
+				_cv.wait( lock, [&]{ return _stop || !_jobs.empty(); } );
+				if( _jobs.empty() ) break;
+				job = std::move( _jobs.front() );
+				_jobs.pop_front();
+				_busy = true;
+			}
+			job();
+		}
+		glfwMakeContextCurrent( nullptr );
+	}
+};
+
+} // namespace JGL2
+
+#endif /* _RenderThread_h */
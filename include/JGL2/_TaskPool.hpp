@@ -0,0 +1,276 @@
+//
+//  _TaskPool.hpp
+//  JGL2
+//
+
+#ifndef _TaskPool_h
+#define _TaskPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace JGL2 {
+
+// Defined in _JGL.hpp: queues f for the UI thread and wakes the main loop
+inline void _postToUIThread( std::function<void()> f );
+
+// Lock-free multi-producer single-consumer queue (Vyukov). Any thread may push;
+// only the UI thread pops. T must be default constructible.
+template<typename T>
+struct _MPSCQueue {
+	_MPSCQueue() { _tail = new Node(); _head.store( _tail ); }
+	~_MPSCQueue() {
+		T v;
+		while( pop(v) );
+		delete _tail;
+	}
+	inline void push( T v ) {
+		Node* n = new Node();
+		n->value = std::move(v);
+		Node* prev = _head.exchange( n, std::memory_order_acq_rel );
+		prev->next.store( n, std::memory_order_release );
+	}
+	inline bool pop( T& v ) {
+		Node* next = _tail->next.load( std::memory_order_acquire );
+		if( !next ) return false;
+		v = std::move( next->value );
+		delete _tail;
+		_tail = next;
+		return true;
+	}
+	inline bool empty() const { return _tail->next.load( std::memory_order_acquire )==nullptr; }
+
+protected:
+	struct Node {
+		std::atomic<Node*>	next = nullptr;
+		T					value;
+	};
+	std::atomic<Node*>	_head;
+	Node*				_tail;
+};
+
+template<typename T> struct Task;
+template<typename T> struct _TaskApply { using type = std::function<void(T&)>; };
+template<> struct _TaskApply<void> { using type = std::function<void()>; };
+
+template<typename T>
+struct _TaskState {
+	using value_t = std::conditional_t<std::is_void_v<T>, char, T>;
+	std::mutex					m;
+	std::condition_variable		cv;
+	bool						done = false;
+	value_t						value {};
+	std::exception_ptr			error;
+	std::function<void()>		cont;
+
+	template<typename F> inline void run( F& work ) {
+		try {
+			if constexpr( std::is_void_v<T> ) work();
+			else value = work();
+		}
+		catch( ... ) { error = std::current_exception(); }
+		std::function<void()> c;
+		{
+			std::unique_lock<std::mutex> lock(m);
+			done = true;
+			c = std::move(cont);
+		}
+		cv.notify_all();
+		if( c ) _postToUIThread( std::move(c) );
+	}
+};
+
+// Handle to work running on the pool. then_on_ui() runs apply with the result on
+// the UI thread once the work is done; if the work threw, onError runs instead.
+template<typename T>
+struct Task {
+	using apply_t = typename _TaskApply<T>::type;
+	using error_t = std::function<void(std::exception_ptr)>;
+
+	Task() {}
+	Task( std::shared_ptr<_TaskState<T>> s ): _s(s) {}
+	inline bool			valid() const { return bool(_s); }
+	inline bool			ready() const { std::unique_lock<std::mutex> lock(_s->m); return _s->done; }
+	inline void			wait() const { std::unique_lock<std::mutex> lock(_s->m); _s->cv.wait( lock, [&]{ return _s->done; } ); }
+	// Blocks until the work is done; rethrows its exception
+	inline decltype(auto) get() const {
+		wait();
+		if( _s->error ) std::rethrow_exception( _s->error );
+		if constexpr( !std::is_void_v<T> ) return (_s->value);
+	}
+	inline Task&		then_on_ui( apply_t apply, error_t onError=nullptr ) {
+		auto s = _s;
+		std::function<void()> c = [s,apply,onError]() {
+			if( s->error ) { if( onError ) onError( s->error ); }
+			else if constexpr( std::is_void_v<T> ) apply();
+			else apply( s->value );
+		};
+		{
+			std::unique_lock<std::mutex> lock(_s->m);
+			if( !_s->done ) { _s->cont = std::move(c); return *this; }
+		}
+		_postToUIThread( std::move(c) );
+		return *this;
+	}
+
+protected:
+	std::shared_ptr<_TaskState<T>> _s;
+};
+
+// Work-stealing pool: each worker pops its own deque from the back and steals from
+// the front of the others. Tasks submitted from a worker go to that worker's deque.
+// _JGL::run() calls shutdown(true) on its way out, which runs every task still
+// queued before joining, so no Task is left pending; the destructor (static
+// destruction) only joins and drops what is left. After shutdown, submitted work
+// runs on the calling thread.
+struct _ThreadPool {
+	_ThreadPool( unsigned n=0 ) {
+		if( n==0 ) n = std::max( 2u, std::thread::hardware_concurrency() )-1;
+		for( unsigned i=0; i<n; i++ ) _workers.push_back( std::make_unique<Worker>() );
+		for( unsigned i=0; i<n; i++ ) _workers[i]->thread = std::thread( [this,i]{ loop(i); } );
+	}
+	~_ThreadPool() { shutdown( false ); }
+	inline size_t		size() const { return _workers.size(); }
+	inline void			submit( std::function<void()> f );
+	// Stops the workers, after running the queued tasks when drain is true
+	inline void			shutdown( bool drain );
+	template<typename F>
+	inline auto			async( F&& work ) -> Task<std::invoke_result_t<std::decay_t<F>>>;
+	// Runs fn(i) for every i in [0,n) on the workers and the calling thread, and returns
+	// when all are done. The caller takes indices too, so it is safe from inside a task
+	template<typename F>
+	inline void			parallelFor( int n, F&& fn );
+
+protected:
+	struct Worker {
+		std::deque<std::function<void()>>	q;
+		std::mutex							m;
+		std::thread							thread;
+	};
+	std::vector<std::unique_ptr<Worker>>	_workers;
+	std::atomic<size_t>			_next = 0;
+	std::atomic<int>			_queued = 0;
+	std::mutex					_sleepMutex;
+	std::condition_variable		_sleepCV;
+	bool						_stop = false;
+	bool						_drain = false;
+
+	static inline int&			workerIndex() { thread_local int i = -1; return i; }
+	static inline const _ThreadPool*& workerPool() { thread_local const _ThreadPool* p = nullptr; return p; }
+	inline bool					take( int i, std::function<void()>& f );
+	inline void					loop( int i );
+};
+
+inline void _ThreadPool::submit( std::function<void()> f ) {
+	bool inWorker = workerPool()==this;
+	{
+		// Held throughout, so that shutdown() either sees this task queued or makes it run here
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		// A draining task may still queue more; anyone else runs it on the spot
+		if( _stop && !( _drain && inWorker ) ) {
+			lock.unlock();
+			f();
+			return;
+		}
+		int i = inWorker ? workerIndex() : -1;
+		if( i<0 ) i = int( _next++ % _workers.size() );
+		{
+			std::unique_lock<std::mutex> qlock(_workers[i]->m);
+			_workers[i]->q.push_back( std::move(f) );
+		}
+		_queued++;
+	}
+	_sleepCV.notify_one();
+}
+
+inline void _ThreadPool::shutdown( bool drain ) {
+	{
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		if( _stop ) return;
+		_stop = true;
+		_drain = drain;
+	}
+	_sleepCV.notify_all();
+	for( auto& w: _workers ) if( w->thread.joinable() ) w->thread.join();
+}
+
+// _queued is decremented under the queue lock, so once every queue was seen empty
+// under its lock, _queued>0 means new work and the caller's wait does not spin
+inline bool _ThreadPool::take( int i, std::function<void()>& f ) {
+	{
+		Worker& w = *_workers[i];
+		std::unique_lock<std::mutex> lock(w.m);
+		if( !w.q.empty() ) { f = std::move( w.q.back() ); w.q.pop_back(); _queued--; return true; }
+	}
+	// Steal without waiting first, then with, so a lost try_lock is not taken for an empty queue
+	for( int pass=0; pass<2; pass++ ) {
+		for( size_t k=1; k<_workers.size(); k++ ) {
+			Worker& w = *_workers[(i+k)%_workers.size()];
+			std::unique_lock<std::mutex> lock(w.m, std::defer_lock);
+			if( pass==0 ) { if( !lock.try_lock() ) continue; }
+			else lock.lock();
+			if( !w.q.empty() ) { f = std::move( w.q.front() ); w.q.pop_front(); _queued--; return true; }
+		}
+	}
+	return false;
+}
+
+inline void _ThreadPool::loop( int i ) {
+	workerIndex() = i;
+	workerPool() = this;
+	while( true ) {
+		std::function<void()> f;
+		if( take( i, f ) ) {
+			f();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_sleepCV.wait( lock, [&]{ return _stop || _queued>0; } );
+		if( _stop && ( !_drain || _queued<=0 ) ) return;
+	}
+}
+
+template<typename F>
+inline auto _ThreadPool::async( F&& work ) -> Task<std::invoke_result_t<std::decay_t<F>>> {
+	using T = std::invoke_result_t<std::decay_t<F>>;
+	auto s = std::make_shared<_TaskState<T>>();
+	submit( [s,w=std::decay_t<F>(std::forward<F>(work))]() mutable { s->run(w); } );
+	return Task<T>(s);
+}
+
+template<typename F>
+inline void _ThreadPool::parallelFor( int n, F&& fn ) {
+	struct State {
+		std::atomic<int>		next = 0, done = 0;
+		std::mutex				m;
+		std::condition_variable	cv;
+	};
+	auto s = std::make_shared<State>();
+	// Helpers that start after every index is taken return without touching fn
+	auto run = [s,n,&fn]() {
+		int i, k = 0;
+		while( (i = s->next++)<n ) { fn( i ); k++; }
+		if( k>0 && (s->done += k)==n ) {
+			std::unique_lock<std::mutex> lock(s->m);
+			s->cv.notify_all();
+		}
+	};
+	int helpers = std::min( n-1, int(_workers.size()) );
+	for( int t=0; t<helpers; t++ ) submit( run );
+	run();
+	std::unique_lock<std::mutex> lock(s->m);
+	s->cv.wait( lock, [&]{ return s->done>=n; } );
+}
+
+} // namespace JGL2
+
+#endif /* _TaskPool_h */
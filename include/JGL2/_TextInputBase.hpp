@@ -455,13 +455,11 @@ inline void _TextInputBase::select(idx_t start,idx_t end) {
 }
 
 inline void _TextInputBase::updateLocations(NVGcontext* vg) {
-	static std::vector<NVGglyphPosition> pos;
 	if( vg ) {
-		pos.resize(_str.length()+1);
-		size_t cnt = nvgTextGlyphPositions(vg, 0, 0, _str.c_str(), 0, pos.data(), int(pos.size()) );
+		const TextLayout& l = _layout_textinputbase_text(vg, _str);
 		_locations.resize(_str.length()+1 );
-		for( size_t i=0; i<cnt; i++ )
-			_locations[i] = pos[i].maxx;
+		for( size_t i=0; i<l.glyphs.size() && i<_locations.size(); i++ )
+			_locations[i] = l.glyphs[i].maxx;
 	}
 }
 
@@ -0,0 +1,132 @@
+//
+//  _TextLayoutCache.hpp
+//  JGL2
+//
+
+#ifndef JGL2__TextLayoutCache_h
+#define JGL2__TextLayoutCache_h
+
+#include <cstring>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <nanovg/nanovg.h>
+
+#include <JGL2/_MathTypes.hpp>
+
+namespace JGL2 {
+
+struct TextLayout {
+	float							bounds[4]	= {0,0,0,0};	// nvgTextBounds at (0,0), top-left aligned
+	float							advance		= 0;
+	std::vector<NVGglyphPosition>	glyphs;						// Filled on the first request
+	bool							hasGlyphs	= false;
+
+	inline sz2_t	size() const { return sz2_t(bounds[2]-bounds[0],bounds[3]-bounds[1]); }
+};
+
+// Measured bounds and glyph positions keyed by (context, font, size, string), with
+// least-recently-used eviction, so labels, menus and text inputs are not re-shaped
+// every frame. A hit does not allocate. UI thread only.
+struct TextLayoutCache {
+	static inline TextLayoutCache&	get() { static TextLayoutCache c; return c; }
+
+	// Sets font, size and top-left alignment on vg and returns the layout of s.
+	// The reference stays valid at least until the next call.
+	inline const TextLayout&	layout( NVGcontext* vg, const str_t& s, float pt, const char* font, bool glyphs=false );
+	// Drops the layouts of vg (e.g. when its pixel ratio changed), or all of them
+	inline void					clear( NVGcontext* vg=nullptr );
+	inline void					capacity( size_t n ) { _capacity = std::max(n,size_t(1)); trim(); }
+	inline size_t				capacity() const { return _capacity; }
+	inline size_t				size() const { return _entries.size(); }
+
+protected:
+	struct Entry {
+		size_t		hash;
+		NVGcontext*	vg;
+		float		pt;
+		str_t		font;
+		str_t		text;
+		TextLayout	layout;
+	};
+	using entry_list_t = std::list<Entry>;
+
+	entry_list_t								_entries;		// Most recent first
+	std::unordered_map<size_t,entry_list_t::iterator>	_index;
+	size_t										_capacity = 4096;
+
+	static inline size_t	hashKey( NVGcontext* vg, const str_t& s, float pt, const char* font );
+	static inline void		measureGlyphs( NVGcontext* vg, const str_t& s, TextLayout& l );
+	inline void				trim();
+};
+
+inline size_t TextLayoutCache::hashKey( NVGcontext* vg, const str_t& s, float pt, const char* font ) {
+	size_t h = std::hash<std::string_view>()( s );
+	auto mix = [&h]( size_t v ) { h ^= v + 0x9e3779b97f4a7c15ull + (h<<6) + (h>>2); };
+	mix( std::hash<std::string_view>()( font ) );
+	mix( std::hash<float>()( pt ) );
+	mix( std::hash<const void*>()( vg ) );
+	return h;
+}
+
+inline void TextLayoutCache::measureGlyphs( NVGcontext* vg, const str_t& s, TextLayout& l ) {
+	l.glyphs.resize( s.length()+1 );
+	int cnt = nvgTextGlyphPositions( vg, 0, 0, s.c_str(), 0, l.glyphs.data(), int(l.glyphs.size()) );
+	l.glyphs.resize( size_t(cnt) );
+	l.hasGlyphs = true;
+}
+
+inline const TextLayout& TextLayoutCache::layout( NVGcontext* vg, const str_t& s, float pt, const char* font, bool glyphs ) {
+	nvgFontSize( vg, pt );
+	nvgFontFace( vg, font );
+	nvgTextAlign( vg, NVG_ALIGN_TOP|NVG_ALIGN_LEFT );
+
+	size_t h = hashKey( vg, s, pt, font );
+	auto found = _index.find( h );
+	if( found!=_index.end() ) {
+		Entry& e = *found->second;
+		if( e.vg==vg && e.pt==pt && e.text==s && e.font==font ) {
+			_entries.splice( _entries.begin(), _entries, found->second );
+			if( glyphs && !e.layout.hasGlyphs ) measureGlyphs( vg, s, e.layout );
+			return e.layout;
+		}
+		// Hash collision: the newer string takes the slot
+		_entries.erase( found->second );
+		_index.erase( found );
+	}
+
+	_entries.push_front( Entry{ h, vg, pt, font, s, {} } );
+	Entry& e = _entries.front();
+	e.layout.advance = nvgTextBounds( vg, 0, 0, s.c_str(), 0, e.layout.bounds );
+	if( glyphs ) measureGlyphs( vg, s, e.layout );
+	_index[h] = _entries.begin();
+	trim();
+	return e.layout;
+}
+
+inline void TextLayoutCache::clear( NVGcontext* vg ) {
+	if( !vg ) {
+		_entries.clear();
+		_index.clear();
+		return;
+	}
+	for( auto i=_entries.begin(); i!=_entries.end(); ) {
+		if( i->vg==vg ) {
+			_index.erase( i->hash );
+			i = _entries.erase( i );
+		}
+		else i++;
+	}
+}
+
+inline void TextLayoutCache::trim() {
+	while( _entries.size()>_capacity ) {
+		_index.erase( _entries.back().hash );
+		_entries.pop_back();
+	}
+}
+
+} // namespace JGL2
+
+#endif /* JGL2__TextLayoutCache_h */
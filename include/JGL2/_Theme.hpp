@@ -218,6 +218,7 @@ struct Theme {
 	virtual sz2_t		_measure_menuitem						(NVGcontext* vg, const str_t& s, bool sep)const=0;
 	virtual sz2_t		_measure_tooltip_text					(NVGcontext* vg, const str_t& s)const=0;
 	virtual sz2_t		_measure_textinputbase_text				(NVGcontext* vg, const str_t& s)const=0;
+	virtual const TextLayout& _layout_textinputbase_text			(NVGcontext* vg, const str_t& s)const=0;
 	virtual bool		_test_scrollbar_horz					(const rct_t& r, const pos_t& p)const=0;
 	virtual bool		_test_scrollbar_vert					(const rct_t& r, const pos_t& p)const=0;
 	virtual void		_draw_popupbox_box						(NVGcontext* vg, const rct_t& r)const=0;
@@ -343,6 +344,9 @@ inline NVGcolor _color_button_shade_pushed() {
 	return Theme::getCurrentTheme()._color_button_shade_pushed();
 }
 
+inline fontname _font_label() {
+	return Theme::getCurrentTheme()._font_label();
+}
 inline fontname _font_menuitem() {
 	return Theme::getCurrentTheme()._font_menuitem();
 }
@@ -574,6 +578,9 @@ inline void _draw_textinputbase_text(NVGcontext* vg, const rct_t& r, const rct_t
 inline sz2_t _measure_textinputbase_text(NVGcontext* vg, const str_t& str) {
 	return Theme::getCurrentTheme()._measure_textinputbase_text(vg,str);
 }
+inline const TextLayout& _layout_textinputbase_text(NVGcontext* vg, const str_t& str) {
+	return Theme::getCurrentTheme()._layout_textinputbase_text(vg,str);
+}
 
 
 
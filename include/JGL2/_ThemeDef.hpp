@@ -119,6 +119,7 @@ struct ThemeDef : public Theme {
 	virtual sz2_t		_measure_menuitem						(NVGcontext* vg, const str_t& s, bool sep)const override;
 	virtual sz2_t		_measure_tooltip_text					(NVGcontext* vg, const str_t& s)const override;
 	virtual sz2_t		_measure_textinputbase_text				(NVGcontext* vg, const str_t& s)const override;
+	virtual const TextLayout& _layout_textinputbase_text			(NVGcontext* vg, const str_t& s)const override;
 	virtual bool		_test_scrollbar_horz					(const rct_t& r, const pos_t& p)const override;
 	virtual bool		_test_scrollbar_vert					(const rct_t& r, const pos_t& p)const override;
 	virtual void		_draw_popupbox_box						(NVGcontext* vg, const rct_t& r)const override;
@@ -901,7 +902,7 @@ inline	void ThemeDef::_draw_textinputbase_box(NVGcontext* vg, const rct_t& r, sh
 inline	void ThemeDef::_draw_textinputbase_selection(NVGcontext* vg, const rct_t& r, const rct_t& sr, float x0, float x1, shade_state_t s) const {
 	if( contains(s,shade_state_t::TARGETTED )&& !contains(s,shade_state_t::WINDOW_UNFOCUSED) ) {
 		nvgSave(vg);
-		nvgScissor(vg, sr.x, sr.y, sr.w, sr.h );
+		nvgIntersectScissor(vg, sr.x, sr.y, sr.w, sr.h );
 		nvgFillColor(vg,_color_targetted_glow() );
 		nvgBeginPath(vg);
 		nvgRect(vg, x0, r.y+4, x1-x0, r.h-8 );
@@ -912,7 +913,7 @@ inline	void ThemeDef::_draw_textinputbase_selection(NVGcontext* vg, const rct_t&
 inline	void ThemeDef::_draw_textinputbase_cursor(NVGcontext* vg, const rct_t& r, const rct_t& sr, float x, shade_state_t s) const {
 	if( contains(s,shade_state_t::TARGETTED ) && !contains(s,shade_state_t::WINDOW_UNFOCUSED) ) {
 		nvgSave(vg);
-		nvgScissor(vg, sr.x, sr.y, sr.w, sr.h );
+		nvgIntersectScissor(vg, sr.x, sr.y, sr.w, sr.h );
 		nvgStrokeColor(vg,_color_label());
 		nvgStrokeWidth(vg,2);
 		nvgPathLineR(vg,pos_t(x,r.y+4),pos_t(0,r.h-8));
@@ -922,7 +923,7 @@ inline	void ThemeDef::_draw_textinputbase_cursor(NVGcontext* vg, const rct_t& r,
 }
 inline	void ThemeDef::_draw_textinputbase_text(NVGcontext* vg, const rct_t& r, const rct_t& sr, const str_t& str, align_t align, shade_state_t state) const {
 	nvgSave(vg);
-	nvgScissor(vg, sr.x, sr.y, sr.w, sr.h );
+	nvgIntersectScissor(vg, sr.x, sr.y, sr.w, sr.h );
 	nvgFontFace(vg, "system");
 	nvgFontSize(vg, _pt_menu_text());
 	nvgFillColor(vg,nvgColorA(_color_label(),_alpha_f_label(state)));
@@ -938,7 +939,11 @@ inline	float ThemeDef::_size_slider_ticks_minor() const { return 3.5f; }
 inline	float ThemeDef::_size_slider_ticks_major() const { return 5; }
 
 inline	sz2_t ThemeDef::_measure_textinputbase_text(NVGcontext* vg, const str_t& str) const {
-	return nvgMeasureText(vg, str, _pt_menu_text(), "system");
+	return _layout_textinputbase_text(vg, str).size();
+}
+
+inline	const TextLayout& ThemeDef::_layout_textinputbase_text(NVGcontext* vg, const str_t& str) const {
+	return TextLayoutCache::get().layout(vg, str, _pt_menu_text(), "system", true);
 }
 
 inline	float ThemeDef::_radius_f_slider_cursor(slide_type_t type)const {
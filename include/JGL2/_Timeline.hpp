@@ -10,6 +10,7 @@
 
 #include <JGL2/_JGL.hpp>
 #include <functional>
+#include <JGL2/_Delegate.hpp>
 
 namespace JGL2 {
 
@@ -20,9 +21,9 @@ template<typename T> struct range_t {
 	inline long span() const { return end - 1 - start; }
 };
 
-typedef std::function<void(long f)>			FrameCallback_t;
-typedef std::function<void(long s,long e)>	RangeCallback_t;
-typedef std::function<void()>				AnimEventCallback_t ;
+typedef Delegate<void(long f)>				FrameCallback_t;
+typedef Delegate<void(long s,long e)>		RangeCallback_t;
+typedef Delegate<void()>					AnimEventCallback_t ;
 
 
 struct _Timeline {
@@ -14,6 +14,7 @@
 #include <nanovg/nanovg.h>
 //#include <nanovg/nanovg_gl.h>
 #include "math.h"
+#include <JGL2/_Draw.hpp>
 
 enum NANO_UI_MOD {
 	MOD_NONE  = 0,
@@ -696,7 +697,8 @@ struct nanoOptions : nanoExpandable {
 			nanoRect expR = expandedRect();
 			nanoRect shdR = expR.expand(NANO_GROUP_SHADOW_WIDTH);
 			nvgSave(vg);
-			nvgScissor(vg, shdR._x, shdR._y, shdR._w, shdR._h);
+			JGL2::nvgResetToFrameScissor(vg);
+			nvgIntersectScissor(vg, shdR._x, shdR._y, shdR._w, shdR._h);
 			drawOptionBack(vg,expR,global().groupColor);
 			for(size_t i=0; i< _options.size(); i++) drawOptionLabel(vg, itemRect((int)i), _options[i], i==_onItem);
 			nvgRestore(vg);
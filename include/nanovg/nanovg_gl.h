@@ -1257,7 +1257,8 @@ static void glnvg__renderFlush(void* uptr)
 		glFrontFace(GL_CCW);
 		glEnable(GL_BLEND);
 		glDisable(GL_DEPTH_TEST);
-		glDisable(GL_SCISSOR_TEST);
+		// The scissor test is left as the caller set it, so that a frame can be clipped
+		// as a whole (JGL2 partial redraws) whatever nvgResetScissor calls it contains
 		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 		glStencilMask(0xffffffff);
 		glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);